@@ -10,24 +10,32 @@ benchmark_names = [
     "wrbenchmark",
     "wsbenchmark",
     "wibenchmark",
+    "wfbenchmark",
+    "scbenchmark",
     "wbenchmark"
 ]
 benchmark_labels = {
     "wrbenchmark": "ARRM",
     "wsbenchmark": "GPRRM",
     "wibenchmark": "iGPRRM",
+    "wfbenchmark": "FLUSH",
+    "scbenchmark": "SEND",
     "wbenchmark": "RDMA WRITE"
 }
 benchmark_styles = {
     "wrbenchmark": "*:",
     "wsbenchmark": "^--",
     "wibenchmark": "x--",
+    "wfbenchmark": "s-.",
+    "scbenchmark": "d:",
     "wbenchmark": ".-."
 }
 legend_labels = [
     "Zapisy metodą ARRM",
     "Zapisy metodą GPRRM",
     "Zapisy metodą iGPRRM",
+    "Zapisy metodą FLUSH",
+    "Zapisy metodą SEND z kopią",
     "Zapisy do pamięci DRAM"
 ]
 memsizes = [
@@ -58,28 +58,42 @@ def client(program: str, node: str, serveraddr: str, memsize: str, threadnum: in
         with open("results.json", "w+") as f:
             json.dump({}, f)
 
+    # latency distribution columns are always the last ones, after the
+    # benchmark specific columns
+    latency_columns = [
+        "lat_min",
+        "lat_max",
+        "lat_stdev",
+        "lat_pctl_50.0",
+        "lat_pctl_90.0",
+        "lat_pctl_99.0",
+        "lat_pctl_99.9",
+        "lat_pctl_99.99",
+        "lat_pctl_99.999",
+    ]
+    latency_distribution = {
+        name: int(value)
+        for name, value in zip(latency_columns, result[-len(latency_columns):])
+    }
+
     with open("results.json", "r") as f:
         RESULTS = json.load(f)
         if not mem_size in RESULTS:
             RESULTS[mem_size] = {}
         if not program in RESULTS[mem_size]:
             RESULTS[mem_size][program] = {}
-        if program == "wsbenchmark":
-            RESULTS[mem_size][program][threadnum] = {
-                "ops": int(result[0]),
-                "latency": int(result[1]),
-                "jitter": int(result[2]),
-                "throughput": float(result[3]),
-                "send_latency": int(result[4]),
-                "send_jitter": int(result[5]),
-            }
-        else:
-            RESULTS[mem_size][program][threadnum] = {
-                "ops": int(result[0]),
-                "latency": int(result[1]),
-                "jitter": int(result[2]),
-                "throughput": float(result[3]),
-            }
+        # all programs are the same engine and print the same columns
+        RESULTS[mem_size][program][threadnum] = {
+            "ops": int(result[0]),
+            "latency": int(result[1]),
+            "jitter": int(result[2]),
+            "throughput": float(result[3]),
+            "ops_per_sec": float(result[4]),
+            "cpu_per_op": int(result[5]),
+            # cpu_per_op in TSC cycles, 0 without an invariant TSC
+            "cpu_cycles_per_op": int(result[-len(latency_columns) - 1]),
+            **latency_distribution,
+        }
 
     with open("results.json", "w") as f:
         json.dump(RESULTS, f)
@@ -128,7 +142,7 @@ def server(
     subprocess.run(args=args, stdout=sys.stdout, stderr=sys.stderr)
 
 
-benchmarks = ["wrbenchmark", "wsbenchmark", "wibenchmark", "rbenchmark", "wbenchmark"]
+benchmarks = ["wrbenchmark", "wsbenchmark", "wibenchmark", "wfbenchmark", "scbenchmark", "rbenchmark", "wbenchmark"]
 mem_sizes = ["256", "512", "1024", "2048", "4096", "8192", "12288", "16384", "20480", "24576", "32768", "65536"]
 # benchmarks = ["rwbenchmark"]
 
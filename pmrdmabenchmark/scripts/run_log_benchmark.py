@@ -0,0 +1,53 @@
+#!/bin/python3
+import json
+from multiprocessing import Process
+from time import sleep
+
+from run_benchmark import client, server
+
+# lgbenchmark appends records to the server's persistent log, every
+# connection is one appender; ops/s are appends/s and the latency is the
+# commit latency of an append
+program = "lgbenchmark"
+record_sizes = [str(1 << shift) for shift in range(6, 17)]  # 64 B - 64 KiB
+appenders = [1, 2, 4, 8, 16]
+
+
+def print_results():
+    """Prints appends/s and commit latency of the sweep from results.json"""
+    with open("results.json", "r") as f:
+        results = json.load(f)
+    print("record [B] | appenders | appends/s | commit lat [ns] | p99 [ns]")
+    for record_size in record_sizes:
+        runs = results.get(record_size, {}).get(program, {})
+        for threadnum in appenders:
+            run = runs.get(str(threadnum))
+            if run:
+                print(record_size, threadnum, run["ops_per_sec"],
+                      run["latency"], run["lat_pctl_99.0"])
+
+
+if __name__ == "__main__":
+    client_node = "pmem-4"
+    server_node = "pmem-3"
+    server_addr = "10.10.0.123"
+
+    for record_size in record_sizes:
+        for threadnum in appenders:
+            clientproc = Process(
+                target=client,
+                args=(program, client_node, server_addr, record_size, threadnum),
+            )
+            serverproc = Process(
+                target=server,
+                args=(program, server_node, server_addr, record_size, threadnum),
+            )
+
+            serverproc.start()
+            sleep(0.1)
+            clientproc.start()
+
+            clientproc.join()
+            serverproc.kill()
+
+    print_results()
@@ -2,15 +2,88 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
 
 #include <rdma/rdma_cma.h>
 #include "common.h"
 
 int use_rs = 1;
 
+int timer_use_tsc;
+uint64_t timer_mult;
+static double timer_overhead;
+
+#define TIMER_CALIBRATION_NS 50000000
+#define TIMER_OVERHEAD_SAMPLES 100000
+
+static uint64_t monotonic_raw_ns(void)
+{
+	struct timespec spec;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+	return (uint64_t)spec.tv_sec * 1000000000 + spec.tv_nsec;
+}
+
+/* Picks the clock behind get_time_ns() and measures the cost of one read,
+ * must run before any worker thread starts.
+ */
+void timer_init(void)
+{
+	uint64_t start, end;
+	int i;
+#if defined(__x86_64__)
+	unsigned int eax, ebx, ecx, edx, aux;
+	uint64_t tsc_start, ns_start, ns;
+
+	/* CPUID.80000007H:EDX[8], the TSC ticks at a constant rate in all
+	 * P-, C- and T-states */
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+	    (edx & (1 << 8))) {
+		ns_start = monotonic_raw_ns();
+		tsc_start = __rdtscp(&aux);
+		do {
+			ns = monotonic_raw_ns() - ns_start;
+		} while (ns < TIMER_CALIBRATION_NS);
+		timer_mult = (ns << 32) / (__rdtscp(&aux) - tsc_start);
+		timer_use_tsc = 1;
+	}
+#endif
+	start = get_time_ns();
+	for (i = 0; i < TIMER_OVERHEAD_SAMPLES; i++)
+		get_time_ns();
+	end = get_time_ns();
+	timer_overhead = (double)(end - start) / TIMER_OVERHEAD_SAMPLES;
+}
+
+double timer_overhead_ns(void)
+{
+	return timer_overhead;
+}
+
+/* TSC cycles of a time in ns at the calibrated rate, 0 without the TSC */
+uint64_t timer_cycles(uint64_t ns)
+{
+	if (!timer_use_tsc)
+		return 0;
+	return ((unsigned __int128)ns << 32) / timer_mult;
+}
+
+void timer_print(void)
+{
+	if (timer_use_tsc)
+		printf("timer: tsc %.3f GHz, overhead %.1f ns\n",
+		       (double)((uint64_t)1 << 32) / timer_mult, timer_overhead);
+	else
+		printf("timer: clock_monotonic, overhead %.1f ns\n",
+		       timer_overhead);
+}
+
 int get_rdma_addr(const char *src, const char *dst, const char *port,
 		  struct rdma_addrinfo *hints, struct rdma_addrinfo **rai)
 {
@@ -141,3 +214,300 @@ struct rdma_event_channel *create_first_event_channel(void)
 	}
 	return channel;
 }
+
+/* Reads a port hardware counter from sysfs, returns -1 if the device doesn't
+ * expose it.
+ */
+long long read_hw_counter(struct ibv_context *verbs, uint8_t port,
+			  const char *name)
+{
+	char path[256];
+	long long value;
+	FILE *f;
+
+	snprintf(path, sizeof path,
+		 "/sys/class/infiniband/%s/ports/%u/hw_counters/%s",
+		 ibv_get_device_name(verbs->device), port, name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%lld", &value) != 1)
+		value = -1;
+	fclose(f);
+	return value;
+}
+
+/* RNR NAKs sent because no receive was posted, counter name depends on the
+ * provider (mlx5, rxe).
+ */
+long long read_rnr_nak_counter(struct ibv_context *verbs, uint8_t port)
+{
+	static const char *names[] = { "out_of_buffer", "send_rnr_err" };
+	long long value;
+	int i;
+
+	for (i = 0; i < (int)(sizeof names / sizeof names[0]); i++) {
+		value = read_hw_counter(verbs, port, names[i]);
+		if (value >= 0)
+			return value;
+	}
+	return -1;
+}
+
+int parse_slot_order(const char *name, enum slot_order *order)
+{
+	if (!strncasecmp("seq", name, 3))
+		*order = SLOT_SEQUENTIAL;
+	else if (!strncasecmp("stride", name, 6))
+		*order = SLOT_STRIDED;
+	else if (!strncasecmp("random", name, 6))
+		*order = SLOT_RANDOM;
+	else
+		return -1;
+	return 0;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while (b) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* The strided order jumps at least SLOT_STRIDE_BYTES between consecutive
+ * slots, so successive writes land on different DIMMs of an interleaved
+ * region. The stride is coprime with the ring size so every slot is visited.
+ */
+void slot_ring_init(struct slot_ring *ring, uint64_t slots, size_t slot_size,
+		    enum slot_order order, unsigned seed)
+{
+	ring->slots = slots ? slots : 1;
+	ring->order = order;
+	ring->next = 0;
+	ring->state = 0x9e3779b97f4a7c15ull * (seed + 1);
+	ring->stride = (SLOT_STRIDE_BYTES + slot_size - 1) / slot_size;
+	if (ring->stride < 2)
+		ring->stride = 2;
+	while (ring->slots > 1 && gcd(ring->stride, ring->slots) != 1)
+		ring->stride++;
+}
+
+uint64_t slot_ring_next(struct slot_ring *ring)
+{
+	uint64_t slot = ring->next;
+
+	switch (ring->order) {
+	case SLOT_SEQUENTIAL:
+		ring->next = (ring->next + 1) % ring->slots;
+		break;
+	case SLOT_STRIDED:
+		ring->next = (ring->next + ring->stride) % ring->slots;
+		break;
+	case SLOT_RANDOM:
+		/* xorshift64 */
+		ring->state ^= ring->state << 13;
+		ring->state ^= ring->state >> 7;
+		ring->state ^= ring->state << 17;
+		slot = ring->state % ring->slots;
+		break;
+	}
+	return slot;
+}
+
+/* Bytes of the mapping owned by one connection in ring layout, a whole number
+ * of slots.
+ */
+size_t slot_ring_share(size_t mapped_len, int connections, size_t slot_size)
+{
+	return mapped_len / connections / slot_size * slot_size;
+}
+
+/* Midpoint of the values counted in a bucket */
+static uint64_t hist_value(int index)
+{
+	int shift;
+
+	if (index < 2 * HIST_SUB_BUCKETS)
+		return index;
+	shift = index / HIST_SUB_BUCKETS - 1;
+	return ((uint64_t)(index % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS) << shift) +
+	       (((uint64_t)1 << shift) - 1) / 2;
+}
+
+void hist_merge(struct latency_histogram *dst,
+		const struct latency_histogram *src)
+{
+	int i;
+
+	if (!src->count)
+		return;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+}
+
+/* Adds the buckets of a histogram another thread keeps recording into. Each
+ * counter has a single writer and is read on its own, so the writer never
+ * waits; count follows the buckets, min and max are left alone.
+ */
+void hist_snapshot(struct latency_histogram *dst,
+		   const struct latency_histogram *src)
+{
+	uint64_t n;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		n = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+		dst->buckets[i] += n;
+		dst->count += n;
+	}
+}
+
+/* The values recorded between two snapshots, min and max are the midpoints
+ * of the outermost non-empty buckets.
+ */
+void hist_delta(struct latency_histogram *dst,
+		const struct latency_histogram *now,
+		const struct latency_histogram *last)
+{
+	int i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		/* a worker that drops its warm-up ops starts over at 0 */
+		dst->buckets[i] = now->buckets[i] >= last->buckets[i] ?
+				  now->buckets[i] - last->buckets[i] :
+				  now->buckets[i];
+		if (!dst->buckets[i])
+			continue;
+		if (!dst->count)
+			dst->min = hist_value(i);
+		dst->max = hist_value(i);
+		dst->count += dst->buckets[i];
+	}
+}
+
+uint64_t hist_percentile(const struct latency_histogram *h, double percentile)
+{
+	uint64_t rank, seen = 0;
+	int i;
+
+	if (!h->count)
+		return 0;
+	rank = (uint64_t)(percentile / 100 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	/* the bucket midpoint may lie past the largest recorded value */
+	return hist_value(i) < h->max ? hist_value(i) : h->max;
+}
+
+double hist_stddev(const struct latency_histogram *h)
+{
+	double mean = 0, variance = 0, delta;
+	int i;
+
+	if (!h->count)
+		return 0;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		mean += (double)hist_value(i) * h->buckets[i];
+	mean /= h->count;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		delta = hist_value(i) - mean;
+		variance += delta * delta * h->buckets[i];
+	}
+	return sqrt(variance / h->count);
+}
+
+void hist_print(const struct latency_histogram *h)
+{
+	puts("min | p50 | p90 | p99 | p99.9 | p99.99 | max | stddev [ns]");
+	printf("%lu %lu %lu %lu %lu %lu %lu %.0f\n", h->min,
+	       hist_percentile(h, 50), hist_percentile(h, 90),
+	       hist_percentile(h, 99), hist_percentile(h, 99.9),
+	       hist_percentile(h, 99.99), h->max, hist_stddev(h));
+}
+
+/* Appends lat_min;lat_max;lat_stdev;lat_pctl_50.0;lat_pctl_90.0;
+ * lat_pctl_99.0;lat_pctl_99.9;lat_pctl_99.99;lat_pctl_99.999 in ns to the
+ * current CSV line, the rpma fio CSVs use the same columns.
+ */
+void hist_print_csv(const struct latency_histogram *h)
+{
+	printf(";%lu;%lu;%.0f;%lu;%lu;%lu;%lu;%lu;%lu", h->min, h->max,
+	       hist_stddev(h), hist_percentile(h, 50), hist_percentile(h, 90),
+	       hist_percentile(h, 99), hist_percentile(h, 99.9),
+	       hist_percentile(h, 99.99), hist_percentile(h, 99.999));
+}
+
+int parse_arrival(const char *name, enum arrival *arrival)
+{
+	if (!strncasecmp("const", name, 5))
+		*arrival = ARRIVAL_CONSTANT;
+	else if (!strncasecmp("poisson", name, 7))
+		*arrival = ARRIVAL_POISSON;
+	else
+		return -1;
+	return 0;
+}
+
+/* rate is in ops/s, the first op is due at start */
+void pacer_init(struct pacer *p, double rate, enum arrival arrival,
+		unsigned seed, uint64_t start)
+{
+	p->interval = 1e9 / rate;
+	p->next = start;
+	p->state = 0x9e3779b97f4a7c15ull * (seed + 1);
+	p->arrival = arrival;
+	p->late = 0;
+}
+
+/* Exponentially distributed gap with the mean interval */
+static double pacer_poisson_gap(struct pacer *p)
+{
+	double u;
+
+	p->state ^= p->state << 13;
+	p->state ^= p->state >> 7;
+	p->state ^= p->state << 17;
+	/* uniform in (0, 1] */
+	u = ((p->state >> 11) + 1) * (1.0 / 9007199254740992.0);
+	return -log(u) * p->interval;
+}
+
+/* Claims the next intended send time, the caller issues the op at now */
+uint64_t pacer_take(struct pacer *p, uint64_t now)
+{
+	uint64_t intended = p->next;
+
+	p->next += p->arrival == ARRIVAL_POISSON ? pacer_poisson_gap(p)
+						 : p->interval;
+	if (now > intended + p->interval)
+		p->late++;
+	return intended;
+}
+
+void pacer_print(double rate, enum arrival arrival, uint64_t ops,
+		 uint64_t late)
+{
+	if (!rate) {
+		puts("load: closed loop");
+		return;
+	}
+	printf("load: open loop %.0f ops/s per connection (%s), %lu of %lu ops "
+	       "issued late\n", rate,
+	       arrival == ARRIVAL_POISSON ? "poisson" : "constant", late, ops);
+}
@@ -2,6 +2,12 @@
 #include <sys/types.h>
 #include <endian.h>
 #include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
 #include <rdma/rdma_cma.h>
 #include <rdma/rsocket.h>
@@ -60,6 +66,109 @@ enum rs_optimization {
 	opt_bandwidth
 };
 
+/* Clock of the worker loops. timer_init() calibrates the invariant TSC
+ * against CLOCK_MONOTONIC_RAW, without one CLOCK_MONOTONIC is read instead.
+ */
+extern int timer_use_tsc;
+extern uint64_t timer_mult; /* ns per tick, 32.32 fixed point */
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec spec;
+#if defined(__x86_64__)
+	unsigned int aux;
+
+	if (timer_use_tsc)
+		return (unsigned __int128)__rdtscp(&aux) * timer_mult >> 32;
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return (uint64_t)spec.tv_sec * 1000000000 + spec.tv_nsec;
+}
+
+/* Open-loop load: ops are issued on a fixed schedule of intended send times,
+ * independent of completions, and latency is measured from the intended time
+ * so server stalls are not hidden by a stalled client (coordinated omission).
+ */
+enum arrival {
+	ARRIVAL_CONSTANT,
+	ARRIVAL_POISSON
+};
+
+struct pacer {
+	double interval;	/* mean ns between intended send times */
+	double next;		/* intended send time of the next op */
+	uint64_t state;
+	enum arrival arrival;
+	uint64_t late;		/* ops issued a whole interval behind schedule */
+};
+
+static inline bool pacer_due(const struct pacer *p, uint64_t now)
+{
+	return now >= p->next;
+}
+
+/* Log-linear latency histogram in the style of HdrHistogram. Values below
+ * 2 * HIST_SUB_BUCKETS ns are exact, every power of two above is split into
+ * HIST_SUB_BUCKETS linear buckets, bounding the error to 1/HIST_SUB_BUCKETS.
+ * Each worker records into its own histogram, they are merged at the end.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct latency_histogram {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+static inline int hist_index(uint64_t value)
+{
+	int shift;
+
+	if (value < 2 * HIST_SUB_BUCKETS)
+		return value;
+	shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	return shift * HIST_SUB_BUCKETS + (value >> shift);
+}
+
+/* The worker is the only writer, its stores are relaxed atomics so that
+ * hist_snapshot() may read the histogram while it records without a race;
+ * no read-modify-write is needed.
+ */
+static inline void hist_record(struct latency_histogram *h, uint64_t value)
+{
+	uint64_t *bucket = &h->buckets[hist_index(value)];
+
+	__atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+	if (!h->count || value < h->min)
+		__atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+	if (value > h->max)
+		__atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+/* Slot ring layout: each connection owns an equal share of the pmem mapping,
+ * split into slots that the client visits in the given order.
+ */
+#define SLOT_ALIGN 64
+#define SLOT_STRIDE_BYTES 4096
+
+enum slot_order {
+	SLOT_SEQUENTIAL,
+	SLOT_STRIDED,
+	SLOT_RANDOM
+};
+
+struct slot_ring {
+	uint64_t slots;
+	uint64_t stride;
+	uint64_t next;
+	uint64_t state;
+	enum slot_order order;
+};
+
 int get_rdma_addr(const char *src, const char *dst, const char *port,
 		  struct rdma_addrinfo *hints, struct rdma_addrinfo **rai);
 
@@ -70,3 +179,32 @@ void format_buf(void *buf, int size);
 int verify_buf(void *buf, int size);
 int do_poll(struct pollfd *fds, int timeout);
 struct rdma_event_channel *create_first_event_channel(void);
+long long read_hw_counter(struct ibv_context *verbs, uint8_t port,
+			  const char *name);
+long long read_rnr_nak_counter(struct ibv_context *verbs, uint8_t port);
+int parse_slot_order(const char *name, enum slot_order *order);
+void slot_ring_init(struct slot_ring *ring, uint64_t slots, size_t slot_size,
+		    enum slot_order order, unsigned seed);
+uint64_t slot_ring_next(struct slot_ring *ring);
+size_t slot_ring_share(size_t mapped_len, int connections, size_t slot_size);
+void hist_merge(struct latency_histogram *dst,
+		const struct latency_histogram *src);
+void hist_snapshot(struct latency_histogram *dst,
+		   const struct latency_histogram *src);
+void hist_delta(struct latency_histogram *dst,
+		const struct latency_histogram *now,
+		const struct latency_histogram *last);
+uint64_t hist_percentile(const struct latency_histogram *h, double percentile);
+double hist_stddev(const struct latency_histogram *h);
+void hist_print(const struct latency_histogram *h);
+void hist_print_csv(const struct latency_histogram *h);
+void timer_init(void);
+double timer_overhead_ns(void);
+uint64_t timer_cycles(uint64_t ns);
+void timer_print(void);
+int parse_arrival(const char *name, enum arrival *arrival);
+void pacer_init(struct pacer *p, double rate, enum arrival arrival,
+		unsigned seed, uint64_t start);
+uint64_t pacer_take(struct pacer *p, uint64_t now);
+void pacer_print(double rate, enum arrival arrival, uint64_t ops,
+		 uint64_t late);
@@ -0,0 +1,241 @@
+#include "pmbenchmark.h"
+
+// RDMA atomics on 8 byte words of the server buffer: fetch-and-add adds 1,
+// compare-and-swap increments the word if it still holds the value fetched
+// last, as a lock or log tail update would, and counts the swaps that
+// fail. Each connection works on the words of its own slots, or with
+// --contended all of them on the one word of the server's shared line. The
+// -read variants follow each atomic with a fenced 0 byte RDMA READ, like
+// write-read, so the word reached the persistence domain when the read
+// completes.
+//
+// The QP keeps at most rd_atomic atomics in flight, an iodepth above it
+// only queues at the client.
+
+// client: each op in flight gets the word its atomic returns, a swap
+// compares with the value its slot's word held after the last op on it.
+// Only the struct and fetched are registered, the swap state follows them.
+struct atomic_client {
+  uint64_t *fetched;  // by seq % iodepth, written by the NIC
+  uint64_t *compare;  // swaps: by seq % iodepth
+  uint64_t *slot;     // swaps: by seq % iodepth
+  uint64_t *expected; // swaps: by slot
+};
+
+// swaps keep a word per slot of the connection, 8 MiB at most
+#define ATOMIC_MAX_SWAP_SLOTS (1 << 20)
+
+// an op moves one word
+static int atomic_check(void) {
+  if (message_size && message_size != sizeof(uint64_t)) {
+    printf("pmbenchmark: atomic methods move %zu byte words, -S must be "
+           "%zu\n", sizeof(uint64_t), sizeof(uint64_t));
+    return -1;
+  }
+  message_size = sizeof(uint64_t);
+  return 0;
+}
+
+static uint64_t atomic_slots(struct benchmark_node *node) {
+  return atomic_contended ? 1 : node->server_metadata->length / slot_size();
+}
+
+static size_t fetch_add_node_data(struct benchmark_node *node,
+                                  size_t *nic_bytes) {
+  (void)node;
+  *nic_bytes = sizeof(struct atomic_client) + iodepth * sizeof(uint64_t);
+  return *nic_bytes;
+}
+
+static size_t cmp_swap_node_data(struct benchmark_node *node,
+                                 size_t *nic_bytes) {
+  uint64_t slots = atomic_slots(node);
+
+  if (slots > ATOMIC_MAX_SWAP_SLOTS) {
+    printf("pmbenchmark: compare and swap keeps a word per slot, %lu slots "
+           "exceed %d, start the server with a smaller -l or use "
+           "--contended\n", slots, ATOMIC_MAX_SWAP_SLOTS);
+    return 0;
+  }
+  return fetch_add_node_data(node, nic_bytes) +
+         (2 * (size_t)iodepth + slots) * sizeof(uint64_t);
+}
+
+static void atomic_prepare(struct benchmark_node *node,
+                           enum ibv_wr_opcode opcode, int op_wrs) {
+  struct atomic_client *client = node->method_data;
+  struct ibv_send_wr *wr;
+  uint32_t rkey = atomic_contended ? node->server_metadata->shared_key
+                                   : node->server_metadata->key.remote_key;
+  int i;
+
+  client->fetched = (uint64_t *)(client + 1);
+  if (opcode == IBV_WR_ATOMIC_CMP_AND_SWP) {
+    client->compare = client->fetched + iodepth;
+    client->slot = client->compare + iodepth;
+    client->expected = client->slot + iodepth;
+  }
+
+  for (i = 0; i < op_wrs * post_batch; i += op_wrs) {
+    wr = &node->send_wr[i];
+    // the original value of the word lands in the op's fetched word, set
+    // per op
+    node->send_sge[i].length = sizeof(uint64_t);
+    node->send_sge[i].lkey = node->method_mr->lkey;
+    wr[0].next = &wr[1];
+    wr[0].sg_list = &node->send_sge[i];
+    wr[0].num_sge = 1;
+    wr[0].opcode = opcode;
+    wr[0].wr.atomic.rkey = rkey;
+    wr[0].wr.atomic.compare_add = 1;
+    if (op_wrs == 1)
+      continue;
+
+    // read destination
+    node->send_sge[i + 1].length = 0;
+    node->send_sge[i + 1].lkey = node->src_mem_mr->lkey;
+    node->send_sge[i + 1].addr = (uintptr_t)node->src_mem;
+    wr[1].next = &wr[2];
+    wr[1].sg_list = &node->send_sge[i + 1];
+    wr[1].num_sge = 1;
+    wr[1].opcode = IBV_WR_RDMA_READ;
+    wr[1].wr.rdma.rkey = rkey;
+  }
+}
+
+static int atomic_post(struct benchmark_node *node, uint64_t seq, int n,
+                       int op_wrs) {
+  struct atomic_client *client = node->method_data;
+  struct ibv_send_wr *wr;
+  uint64_t remote_addr, slot;
+  int i, k;
+
+  for (i = 0; i < n; ++i) {
+    wr = &node->send_wr[op_wrs * i];
+    k = (seq + i) % iodepth;
+    slot = atomic_contended ? 0 : next_slot_offset(node) / slot_size();
+    remote_addr = atomic_contended
+                      ? node->server_metadata->shared_address
+                      : node->server_metadata->address + slot * slot_size();
+    node->send_sge[op_wrs * i].addr = (uintptr_t)&client->fetched[k];
+    wr[0].wr_id = seq + i;
+    wr[0].wr.atomic.remote_addr = remote_addr;
+    if (wr[0].opcode == IBV_WR_ATOMIC_CMP_AND_SWP) {
+      // the next op on the slot expects this swap to succeed, a failure
+      // corrects it in cmp_swap_poll()
+      client->slot[k] = slot;
+      client->compare[k] = client->expected[slot];
+      client->expected[slot] = client->compare[k] + 1;
+      wr[0].wr.atomic.compare_add = client->compare[k];
+      wr[0].wr.atomic.swap = client->compare[k] + 1;
+    }
+    if (op_wrs == 1) {
+      wr[0].send_flags = op_signal(seq + i);
+      continue;
+    }
+    // the fence holds the read until the atomic executed, only the read is
+    // signaled
+    wr[0].send_flags = 0;
+    wr[1].send_flags = IBV_SEND_FENCE | op_signal(seq + i);
+    wr[1].wr_id = seq + i;
+    wr[1].wr.rdma.remote_addr = remote_addr;
+  }
+  return post_prepared(node, n, op_wrs);
+}
+
+// a swap failed when its slot's word was not the value compared with, the
+// word it returned is what the next op on the slot compares with
+static int cmp_swap_poll(struct benchmark_node *node, uint64_t *completed) {
+  struct atomic_client *client = node->method_data;
+  uint64_t seq = *completed;
+  int k, ret;
+
+  ret = poll_sends(node, completed);
+  for (; seq < *completed; ++seq) {
+    k = seq % iodepth;
+    if (client->fetched[k] == client->compare[k])
+      continue;
+    client->expected[client->slot[k]] = client->fetched[k];
+    if (node->measuring && seq >= node->measured_from)
+      node->stats->failed++;
+  }
+  return ret;
+}
+
+static void fetch_add_prepare(struct benchmark_node *node) {
+  atomic_prepare(node, IBV_WR_ATOMIC_FETCH_AND_ADD, 1);
+}
+
+static void fetch_add_read_prepare(struct benchmark_node *node) {
+  atomic_prepare(node, IBV_WR_ATOMIC_FETCH_AND_ADD, 2);
+}
+
+static void cmp_swap_prepare(struct benchmark_node *node) {
+  atomic_prepare(node, IBV_WR_ATOMIC_CMP_AND_SWP, 1);
+}
+
+static void cmp_swap_read_prepare(struct benchmark_node *node) {
+  atomic_prepare(node, IBV_WR_ATOMIC_CMP_AND_SWP, 2);
+}
+
+static int atomic_post_1(struct benchmark_node *node, uint64_t seq, int n) {
+  return atomic_post(node, seq, n, 1);
+}
+
+static int atomic_post_2(struct benchmark_node *node, uint64_t seq, int n) {
+  return atomic_post(node, seq, n, 2);
+}
+
+const struct method fetch_add_method = {
+    .name = "fetch-add",
+    .description = "RDMA ATOMIC FETCH AND ADD of a word",
+    .send_wrs = 1,
+    .max_ranges = 1,
+    .shared_word = true,
+    .check = atomic_check,
+    .node_data = fetch_add_node_data,
+    .prepare = fetch_add_prepare,
+    .post = atomic_post_1,
+    .poll = poll_sends,
+};
+
+const struct method fetch_add_read_method = {
+    .name = "fetch-add-read",
+    .description = "RDMA ATOMIC FETCH AND ADD and a 0 byte RDMA READ",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .shared_word = true,
+    .check = atomic_check,
+    .node_data = fetch_add_node_data,
+    .prepare = fetch_add_read_prepare,
+    .post = atomic_post_2,
+    .poll = poll_sends,
+};
+
+const struct method cmp_swap_method = {
+    .name = "cmp-swap",
+    .description = "RDMA ATOMIC COMPARE AND SWAP of a word",
+    .send_wrs = 1,
+    .max_ranges = 1,
+    .shared_word = true,
+    .swaps = true,
+    .check = atomic_check,
+    .node_data = cmp_swap_node_data,
+    .prepare = cmp_swap_prepare,
+    .post = atomic_post_1,
+    .poll = cmp_swap_poll,
+};
+
+const struct method cmp_swap_read_method = {
+    .name = "cmp-swap-read",
+    .description = "RDMA ATOMIC COMPARE AND SWAP and a 0 byte RDMA READ",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .shared_word = true,
+    .swaps = true,
+    .check = atomic_check,
+    .node_data = cmp_swap_node_data,
+    .prepare = cmp_swap_read_prepare,
+    .post = atomic_post_2,
+    .poll = cmp_swap_poll,
+};
@@ -0,0 +1,369 @@
+#include <libpmem.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pmbenchmark.h"
+
+// A persistent append-only log shared by all connections. The server's
+// buffer is a circular log addressed by log sequence numbers, byte offsets
+// that only grow, a record of lsn sits at lsn % length. The shared line
+// keeps the log's metadata:
+//  - tail, the bytes reserved so far; clients reserve a record with an
+//    RDMA FETCH AND ADD of its line aligned length
+//  - committed, all records before it are durable
+//  - head, the log is truncated up to it
+//
+// An append is the reservation, one RDMA WRITE of the record, two when it
+// wraps around the end, and a SEND asking the server to commit it, as in
+// write-send. The server flushes the record and drains it on its own, not
+// with the engine's drain of the batch: only then may it mark it committed,
+// since any thread may advance committed over it. It advances committed
+// over the records that are now contiguous and persists the metadata with
+// the batch's drain before it replies. Once more than half of the log is
+// committed the server truncates it, head moves up to committed. A client
+// whose reservation would overwrite the records before head + length waits,
+// reading head, before it writes; records are at most half the log, so the
+// oldest reservation always fits.
+//
+// On start the server keeps the log it finds in the mapping and drops the
+// reservations that were not committed.
+
+#define LOG_MAGIC 0x31474f4c4d4d5250 // "PRMMLOG1"
+
+// the shared line, the tail first for the fetch and add
+struct log_metadata {
+  uint64_t tail;
+  uint64_t committed;
+  uint64_t head;
+  uint64_t magic;
+  uint64_t length;
+};
+
+struct __attribute((packed)) log_request {
+  uint64_t lsn;    // where the reservation put the record
+  uint32_t length; // of the record
+  uint32_t unused;
+  uint64_t head; // client: read while waiting for space, not sent
+};
+
+#define LOG_REQUEST_SIZE offsetof(struct log_request, head)
+
+// client: wr_id tags of the work requests that are not the commit SEND
+#define LOG_WR_RESERVE (1ull << 63)
+#define LOG_WR_HEAD (1ull << 62)
+
+#define LOG_COMMIT_BATCH 16
+
+// client: per connection, ops are reserved, written and committed in order
+struct log_client {
+  uint64_t reserved;   // ops whose reservation completed
+  uint64_t committing; // next op to write and commit
+  uint64_t head;       // as last read from the server
+  bool head_pending;   // a read of head is in flight
+};
+
+// server
+static struct log_metadata *metadata;
+static char *log_base;
+static uint64_t log_length;
+static uint32_t *commit_map; // committed records in lines, by first line
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t record_space(uint64_t length) {
+  return (length + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+}
+
+static struct log_request *log_request(struct benchmark_node *node,
+                                       uint64_t seq) {
+  return (struct log_request *)(node->requests +
+                                seq % iodepth * sizeof(struct log_request));
+}
+
+// the FAA of each op returns its lsn into its request buffer
+static void log_prepare(struct benchmark_node *node) {
+  struct log_request *request;
+  int k;
+
+  for (k = 0; k < iodepth; ++k) {
+    request = log_request(node, k);
+    request->length = message_size;
+  }
+
+  for (k = 0; k < post_batch; ++k) {
+    node->send_sge[k].length = sizeof(uint64_t);
+    node->send_sge[k].lkey = node->request_mr->lkey;
+
+    node->send_wr[k].next = &node->send_wr[k + 1];
+    node->send_wr[k].sg_list = &node->send_sge[k];
+    node->send_wr[k].num_sge = 1;
+    node->send_wr[k].opcode = IBV_WR_ATOMIC_FETCH_AND_ADD;
+    node->send_wr[k].send_flags = IBV_SEND_SIGNALED;
+    node->send_wr[k].wr.atomic.remote_addr =
+        node->server_metadata->shared_address +
+        offsetof(struct log_metadata, tail);
+    node->send_wr[k].wr.atomic.rkey = node->server_metadata->shared_key;
+    node->send_wr[k].wr.atomic.compare_add = record_space(message_size);
+  }
+}
+
+// reserves the records of n ops, they are written once the reservations
+// complete, see log_poll()
+static int log_post(struct benchmark_node *node, uint64_t seq, int n) {
+  int k, ret;
+
+  ret = post_recv_replies(node, seq, n);
+  if (ret)
+    return ret;
+
+  for (k = 0; k < n; ++k) {
+    node->send_sge[k].addr = (uintptr_t)&log_request(node, seq + k)->lsn;
+    node->send_wr[k].wr_id = (seq + k) | LOG_WR_RESERVE;
+  }
+  return post_prepared(node, n, 1);
+}
+
+static void set_sge(struct ibv_sge *sge, uint64_t addr, uint32_t length,
+                    uint32_t lkey) {
+  sge->addr = addr;
+  sge->length = length;
+  sge->lkey = lkey;
+}
+
+// chains the write of the op's record, split where the log wraps, and the
+// SEND of its request; returns the work requests used
+static int chain_append(struct benchmark_node *node, uint64_t seq,
+                        struct ibv_send_wr *wr, struct ibv_sge *sge) {
+  struct log_request *request = log_request(node, seq);
+  uint64_t length = node->server_metadata->length;
+  uint64_t offset = request->lsn % length;
+  uint32_t first = message_size;
+  int i, n = 0;
+
+  if (offset + message_size > length)
+    first = length - offset;
+  memset(wr, 0, 3 * sizeof *wr);
+
+  set_sge(&sge[n], (uintptr_t)node->src_mem, first, node->src_mem_mr->lkey);
+  wr[n].opcode = IBV_WR_RDMA_WRITE;
+  wr[n].send_flags = node->inline_flag;
+  wr[n].wr.rdma.remote_addr = node->server_metadata->address + offset;
+  n++;
+  if (first < message_size) {
+    set_sge(&sge[n], (uintptr_t)node->src_mem + first, message_size - first,
+            node->src_mem_mr->lkey);
+    wr[n].opcode = IBV_WR_RDMA_WRITE;
+    wr[n].send_flags = node->inline_flag;
+    wr[n].wr.rdma.remote_addr = node->server_metadata->address;
+    n++;
+  }
+  set_sge(&sge[n], (uintptr_t)request, LOG_REQUEST_SIZE,
+          node->request_mr->lkey);
+  wr[n].opcode = IBV_WR_SEND;
+  wr[n].send_flags =
+      (LOG_REQUEST_SIZE <= node->max_inline_data ? IBV_SEND_INLINE : 0) |
+      op_signal(seq);
+  n++;
+
+  for (i = 0; i < n; ++i) {
+    wr[i].wr_id = seq;
+    wr[i].sg_list = &sge[i];
+    wr[i].num_sge = 1;
+    wr[i].next = &wr[i + 1];
+    if (wr[i].opcode == IBV_WR_RDMA_WRITE)
+      wr[i].wr.rdma.rkey = node->server_metadata->key.remote_key;
+  }
+  return n;
+}
+
+static int post_head_read(struct benchmark_node *node,
+                          struct log_client *client) {
+  struct ibv_send_wr wr = {0}, *bad_wr;
+  struct ibv_sge sge;
+  int ret;
+
+  set_sge(&sge, (uintptr_t)&log_request(node, client->committing)->head,
+          sizeof(uint64_t), node->request_mr->lkey);
+  wr.wr_id = client->committing | LOG_WR_HEAD;
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  wr.opcode = IBV_WR_RDMA_READ;
+  wr.send_flags = IBV_SEND_SIGNALED;
+  wr.wr.rdma.remote_addr = node->server_metadata->shared_address +
+                           offsetof(struct log_metadata, head);
+  wr.wr.rdma.rkey = node->server_metadata->shared_key;
+  ret = ibv_post_send(node->cma_id->qp, &wr, &bad_wr);
+  if (ret)
+    printf("pmbenchmark: node %d failed to post head read: %d\n", node->id,
+           ret);
+  else
+    client->head_pending = true;
+  return ret;
+}
+
+static size_t log_node_data(struct benchmark_node *node, size_t *nic_bytes) {
+  (void)node;
+  (void)nic_bytes;
+  return sizeof(struct log_client);
+}
+
+// writes and commits the reserved ops in order, up to the first whose
+// record does not fit before head + length; that one reads head again
+static int commit_reserved(struct benchmark_node *node,
+                           struct log_client *client) {
+  struct ibv_send_wr wr[3 * LOG_COMMIT_BATCH], *bad_wr;
+  struct ibv_sge sge[3 * LOG_COMMIT_BATCH];
+  uint64_t end, length = node->server_metadata->length;
+  int n = 0, ops = 0, ret;
+
+  while (client->committing < client->reserved && ops < LOG_COMMIT_BATCH) {
+    end = log_request(node, client->committing)->lsn +
+          record_space(message_size);
+    if (end > client->head + length) {
+      if (!client->head_pending) {
+        ret = post_head_read(node, client);
+        if (ret)
+          return ret;
+      }
+      break;
+    }
+    n += chain_append(node, client->committing, &wr[n], &sge[n]);
+    client->committing++;
+    ops++;
+  }
+  if (!n)
+    return 0;
+
+  wr[n - 1].next = NULL;
+  ret = ibv_post_send(node->cma_id->qp, wr, &bad_wr);
+  if (ret)
+    printf("pmbenchmark: node %d failed to post send: %d\n", node->id, ret);
+  return ret;
+}
+
+// an op is done when the server's reply says its record is committed
+static int log_poll(struct benchmark_node *node, uint64_t *completed) {
+  struct log_client *client = node->method_data;
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  int i, ret;
+
+  ret = node_poll_cq_batch(node, SEND_CQ_INDEX, wc);
+  if (ret < 0)
+    return ret;
+  for (i = 0; i < ret; ++i) {
+    if (wc[i].wr_id & LOG_WR_RESERVE) {
+      client->reserved = (wc[i].wr_id & ~LOG_WR_RESERVE) + 1;
+    } else if (wc[i].wr_id & LOG_WR_HEAD) {
+      client->head = log_request(node, wc[i].wr_id & ~LOG_WR_HEAD)->head;
+      client->head_pending = false;
+    }
+  }
+  ret = commit_reserved(node, client);
+  if (ret)
+    return ret;
+  return poll_reply_cq(node, completed);
+}
+
+// keeps a log of the same length, formats anything else
+static int log_serve_init(void *shared, char *buffer, size_t length) {
+  metadata = shared;
+  log_base = buffer;
+  log_length = length;
+  if (record_space(message_size) > log_length / 2) {
+    printf("pmbenchmark: log of %lu bytes too small for %u byte records\n",
+           log_length, message_size);
+    return -1;
+  }
+
+  commit_map = calloc(log_length / SLOT_ALIGN, sizeof *commit_map);
+  if (!commit_map) {
+    printf("pmbenchmark: failed commit map allocation\n");
+    return -1;
+  }
+
+  if (metadata->magic != LOG_MAGIC || metadata->length != log_length) {
+    memset(metadata, 0, sizeof *metadata);
+    metadata->magic = LOG_MAGIC;
+    metadata->length = log_length;
+  }
+  metadata->tail = metadata->committed;
+  if (use_pmem)
+    pmem_persist(metadata, sizeof *metadata);
+  printf("pmbenchmark: log of %lu bytes, head %lu, committed %lu\n",
+         log_length, metadata->head, metadata->committed);
+  return 0;
+}
+
+static void flush_record(uint64_t lsn, uint32_t length) {
+  uint64_t offset = lsn % log_length;
+  uint64_t first = length;
+
+  if (offset + length > log_length)
+    first = log_length - offset;
+  pmem_flush(log_base + offset, first);
+  if (first < length)
+    pmem_flush(log_base, length - first);
+}
+
+// the record is durable before it is marked, so committed only ever
+// covers durable records whichever thread advances it; this costs a drain
+// per record on top of the engine's drain per batch
+static uint8_t log_serve(struct benchmark_node *node, struct ibv_wc *wc,
+                         void *buffer) {
+  struct log_request *request = buffer;
+  uint64_t committed, lines;
+
+  (void)node;
+  if (wc->byte_len < LOG_REQUEST_SIZE || request->lsn % SLOT_ALIGN ||
+      record_space(request->length) > log_length / 2)
+    return 1;
+
+  if (use_pmem) {
+    flush_record(request->lsn, request->length);
+    pmem_drain();
+  }
+
+  // a record outside the window of the log was committed twice or never
+  // reserved
+  pthread_mutex_lock(&commit_lock);
+  if (request->lsn < metadata->committed ||
+      request->lsn + record_space(request->length) >
+          metadata->head + log_length) {
+    pthread_mutex_unlock(&commit_lock);
+    return 1;
+  }
+  commit_map[request->lsn / SLOT_ALIGN % (log_length / SLOT_ALIGN)] =
+      record_space(request->length) / SLOT_ALIGN;
+
+  committed = metadata->committed;
+  while ((lines = commit_map[committed / SLOT_ALIGN %
+                             (log_length / SLOT_ALIGN)])) {
+    commit_map[committed / SLOT_ALIGN % (log_length / SLOT_ALIGN)] = 0;
+    committed += lines * SLOT_ALIGN;
+  }
+  metadata->committed = committed;
+  // truncation keeps committed - head within half of the log
+  if (committed - metadata->head > log_length / 2)
+    metadata->head = committed;
+  if (use_pmem)
+    pmem_flush(&metadata->committed, 2 * sizeof(uint64_t));
+  pthread_mutex_unlock(&commit_lock);
+  return 0;
+}
+
+const struct method log_append_method = {
+    .name = "log-append",
+    .description = "append to a shared persistent log, FETCH AND ADD "
+                   "reservation, RDMA WRITE and a SEND to commit",
+    .send_wrs = 4,
+    .max_ranges = 1,
+    .request_size = sizeof(struct log_request),
+    .shared_word = true,
+    .shared_log = true,
+    .node_data = log_node_data,
+    .prepare = log_prepare,
+    .post = log_post,
+    .poll = log_poll,
+    .serve = log_serve,
+    .serve_init = log_serve_init,
+};
@@ -0,0 +1,61 @@
+#include "pmbenchmark.h"
+
+// plain RDMA READ of a slot into the local source buffer
+
+static void read_prepare(struct benchmark_node *node) {
+  int i;
+
+  // destination, shared by all reads
+  node->send_sge[0].length = message_size;
+  node->send_sge[0].lkey = node->src_mem_mr->lkey;
+  node->send_sge[0].addr = (uintptr_t)node->src_mem;
+
+  for (i = 0; i < post_batch; ++i) {
+    node->send_wr[i].next = &node->send_wr[i + 1];
+    node->send_wr[i].sg_list = node->send_sge;
+    node->send_wr[i].num_sge = 1;
+    node->send_wr[i].opcode = IBV_WR_RDMA_READ;
+    node->send_wr[i].wr.rdma.rkey = node->server_metadata->key.remote_key;
+  }
+}
+
+static int read_post(struct benchmark_node *node, uint64_t seq, int n) {
+  struct ibv_send_wr *wr = node->send_wr;
+  int i;
+
+  for (i = 0; i < n; ++i) {
+    wr[i].send_flags = op_signal(seq + i);
+    wr[i].wr_id = seq + i;
+    wr[i].wr.rdma.remote_addr =
+        node->server_metadata->address + next_slot_offset(node);
+  }
+  return post_prepared(node, n, 1);
+}
+
+static int read_post_wr(struct benchmark_node *node, uint64_t seq, int n) {
+  struct ibv_qp_ex *qpx = node->qpx;
+  int i;
+
+  ibv_wr_start(qpx);
+  for (i = 0; i < n; ++i) {
+    qpx->wr_id = seq + i;
+    qpx->wr_flags = op_signal(seq + i);
+    ibv_wr_rdma_read(qpx, node->server_metadata->key.remote_key,
+                     node->server_metadata->address + next_slot_offset(node));
+    ibv_wr_set_sge(qpx, node->src_mem_mr->lkey, (uintptr_t)node->src_mem,
+                   message_size);
+  }
+  return wr_complete(node);
+}
+
+const struct method read_method = {
+    .name = "read",
+    .description = "RDMA READ",
+    .send_wrs = 1,
+    .max_ranges = 1,
+    .prepare = read_prepare,
+    .post = read_post,
+    .post_wr = read_post_wr,
+    .wr_send_ops = IBV_QP_EX_WITH_RDMA_READ,
+    .poll = poll_sends,
+};
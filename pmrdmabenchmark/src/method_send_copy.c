@@ -0,0 +1,99 @@
+#include <libpmem.h>
+#include <string.h>
+
+#include "pmbenchmark.h"
+
+// Two-sided baseline: the record travels in a SEND. The server receives it
+// into a registered DRAM buffer of its receive pool and copies it to pmem
+// with pmem_memcpy_nodrain, whose non-temporal stores skip the caches the
+// NIC placed the payload in through DDIO. The engine drains once per polled
+// batch and replies, with -N 1 each record is persisted on its own as
+// pmem_memcpy_persist would.
+
+// the record follows the request in the SEND and in the receive buffer
+struct __attribute((packed)) send_request {
+  uint64_t address; // offset of the record in the connection's buffer
+};
+
+// each op is one SEND of the request from node->requests[seq % iodepth]
+// and of the record from the source buffer
+static void send_copy_prepare(struct benchmark_node *node) {
+  int k;
+
+  // inline if request and record fit
+  node->request_flag =
+      sizeof(struct send_request) + message_size <= node->max_inline_data
+          ? IBV_SEND_INLINE
+          : 0;
+
+  for (k = 0; k < post_batch; ++k) {
+    node->send_sge[2 * k].length = sizeof(struct send_request);
+    node->send_sge[2 * k].lkey = node->request_mr->lkey;
+    node->send_sge[2 * k + 1].length = message_size;
+    node->send_sge[2 * k + 1].lkey = node->src_mem_mr->lkey;
+    node->send_sge[2 * k + 1].addr = (uintptr_t)node->src_mem;
+
+    node->send_wr[k].next = &node->send_wr[k + 1];
+    node->send_wr[k].sg_list = &node->send_sge[2 * k];
+    node->send_wr[k].num_sge = 2;
+    node->send_wr[k].opcode = IBV_WR_SEND;
+  }
+}
+
+static int send_copy_post(struct benchmark_node *node, uint64_t seq, int n) {
+  struct send_request *request;
+  int k, ret;
+
+  // replies are received in the order of the requests
+  ret = post_recv_replies(node, seq, n);
+  if (ret)
+    return ret;
+
+  for (k = 0; k < n; ++k) {
+    request = (struct send_request *)(node->requests +
+                                      (seq + k) % iodepth *
+                                          sizeof(struct send_request));
+    request->address = next_slot_offset(node);
+    node->send_sge[2 * k].addr = (uintptr_t)request;
+    node->send_wr[k].send_flags = node->request_flag | op_signal(seq + k);
+    node->send_wr[k].wr_id = seq + k;
+  }
+  return post_prepared(node, n, 1);
+}
+
+// copies the record to its slot, the drain is shared by the batch; returns
+// the notification status, > 0 if the record lies outside the connection's
+// buffer
+static uint8_t send_copy_serve(struct benchmark_node *node, struct ibv_wc *wc,
+                               void *buffer) {
+  struct send_request *request = buffer;
+  uint32_t length;
+  char *dest;
+
+  if (wc->byte_len < sizeof(struct send_request))
+    return 1;
+  length = wc->byte_len - sizeof(struct send_request);
+  if (request->address > node_buffer_size() ||
+      length > node_buffer_size() - request->address)
+    return 1;
+
+  dest = (char *)node->mem + request->address;
+  if (use_pmem)
+    pmem_memcpy_nodrain(dest, request + 1, length);
+  else
+    memcpy(dest, request + 1, length);
+  return 0;
+}
+
+const struct method send_copy_method = {
+    .name = "send-copy",
+    .description = "SEND of the record, the server copies it to pmem",
+    .send_wrs = 1,
+    .max_ranges = 1,
+    .request_size = sizeof(struct send_request),
+    .request_payload = true,
+    .prepare = send_copy_prepare,
+    .post = send_copy_post,
+    .poll = poll_replies,
+    .serve = send_copy_serve,
+};
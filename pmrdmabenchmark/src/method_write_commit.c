@@ -0,0 +1,209 @@
+#include "pmbenchmark.h"
+
+// Commit records: an RDMA WRITE of the record, then an 8 byte commit marker
+// right after it in the slot, the op's sequence number a log reader checks
+// before it trusts the record. The marker goes out either as a second plain
+// RDMA WRITE or as an RDMA ATOMIC WRITE, which the server sees all at once
+// and never torn. The -flush variants end each op with an RDMA FLUSH of
+// record and marker so the commit is durable when the op completes.
+//
+// All variants post through the ibv_wr_* calls so they differ in the
+// marker alone. ATOMIC WRITE and FLUSH need a recent rdma-core, CMake
+// defines HAVE_IBV_WR_ATOMIC_WRITE and HAVE_IBV_WR_FLUSH when the verbs
+// headers have them.
+
+#ifdef HAVE_IBV_WR_ATOMIC_WRITE
+#define ATOMIC_WRITE_OPS IBV_QP_EX_WITH_ATOMIC_WRITE
+#else
+#define ATOMIC_WRITE_OPS 0
+#endif
+
+#ifdef HAVE_IBV_WR_FLUSH
+#define FLUSH_OPS IBV_QP_EX_WITH_FLUSH
+#define FLUSH_ACCESS IBV_ACCESS_FLUSH_PERSISTENT
+#else
+#define FLUSH_OPS 0
+#define FLUSH_ACCESS 0
+#endif
+
+#define MARKER_SIZE sizeof(uint64_t)
+
+// the marker is aligned right after the record
+static uint64_t marker_offset(void) {
+  return (message_size + MARKER_SIZE - 1) / MARKER_SIZE * MARKER_SIZE;
+}
+
+static int atomic_marker_check(void) {
+#ifndef HAVE_IBV_WR_ATOMIC_WRITE
+  printf("pmbenchmark: atomic markers need ibv_wr_atomic_write, rebuild "
+         "against an rdma-core that has it\n");
+  return -1;
+#else
+  return 0;
+#endif
+}
+
+static int flush_check(void) {
+#ifndef HAVE_IBV_WR_FLUSH
+  printf("pmbenchmark: -flush methods need ibv_wr_flush, rebuild against "
+         "an rdma-core that has it\n");
+  return -1;
+#else
+  return 0;
+#endif
+}
+
+static int atomic_marker_flush_check(void) {
+  return atomic_marker_check() || flush_check() ? -1 : 0;
+}
+
+// the methods whose check() fails never get here without the verb
+static void post_atomic_marker(struct ibv_qp_ex *qpx, uint32_t rkey,
+                               uint64_t remote_addr, uint64_t *marker) {
+#ifdef HAVE_IBV_WR_ATOMIC_WRITE
+  ibv_wr_atomic_write(qpx, rkey, remote_addr, marker);
+#else
+  (void)qpx, (void)rkey, (void)remote_addr, (void)marker;
+#endif
+}
+
+static void post_flush(struct ibv_qp_ex *qpx, uint32_t rkey,
+                       uint64_t remote_addr, size_t length) {
+#ifdef HAVE_IBV_WR_FLUSH
+  ibv_wr_flush(qpx, rkey, remote_addr, length, IBV_FLUSH_PERSISTENT,
+               IBV_FLUSH_RANGE);
+#else
+  (void)qpx, (void)rkey, (void)remote_addr, (void)length;
+#endif
+}
+
+// client: the marker of each op in flight by seq % iodepth, registered so
+// a marker that can't be inlined is written from there
+static size_t marker_node_data(struct benchmark_node *node,
+                               size_t *nic_bytes) {
+  (void)node;
+  *nic_bytes = iodepth * MARKER_SIZE;
+  return *nic_bytes;
+}
+
+static void commit_prepare(struct benchmark_node *node) {
+  // the ibv_wr_* calls take every field per op, nothing to prefill
+  (void)node;
+}
+
+static int commit_post(struct benchmark_node *node, uint64_t seq, int n,
+                       bool atomic, bool flush) {
+  struct ibv_qp_ex *qpx = node->qpx;
+  uint32_t rkey = node->server_metadata->key.remote_key;
+  uint64_t remote_addr, *marker;
+  int i;
+
+  ibv_wr_start(qpx);
+  for (i = 0; i < n; ++i) {
+    remote_addr = node->server_metadata->address + next_slot_offset(node);
+    marker = (uint64_t *)node->method_data + (seq + i) % iodepth;
+    *marker = seq + i + 1;
+
+    qpx->wr_id = seq + i;
+    qpx->wr_flags = 0;
+    ibv_wr_rdma_write(qpx, rkey, remote_addr);
+    wr_set_message(node);
+
+    // inline and atomic markers are copied into the work request when
+    // posted, any other is read from the op's word until it completes
+    qpx->wr_flags = flush ? 0 : op_signal(seq + i);
+    if (atomic) {
+      post_atomic_marker(qpx, rkey, remote_addr + marker_offset(), marker);
+    } else {
+      ibv_wr_rdma_write(qpx, rkey, remote_addr + marker_offset());
+      if (node->max_inline_data >= MARKER_SIZE)
+        ibv_wr_set_inline_data(qpx, marker, MARKER_SIZE);
+      else
+        ibv_wr_set_sge(qpx, node->method_mr->lkey, (uintptr_t)marker,
+                       MARKER_SIZE);
+    }
+
+    if (flush) {
+      qpx->wr_flags = op_signal(seq + i);
+      post_flush(qpx, rkey, remote_addr, marker_offset() + MARKER_SIZE);
+    }
+  }
+  return wr_complete(node);
+}
+
+static int write_marker_post(struct benchmark_node *node, uint64_t seq,
+                             int n) {
+  return commit_post(node, seq, n, false, false);
+}
+
+static int write_marker_flush_post(struct benchmark_node *node, uint64_t seq,
+                                   int n) {
+  return commit_post(node, seq, n, false, true);
+}
+
+static int write_atomic_marker_post(struct benchmark_node *node, uint64_t seq,
+                                    int n) {
+  return commit_post(node, seq, n, true, false);
+}
+
+static int write_atomic_marker_flush_post(struct benchmark_node *node,
+                                          uint64_t seq, int n) {
+  return commit_post(node, seq, n, true, true);
+}
+
+const struct method write_marker_method = {
+    .name = "write-marker",
+    .description = "RDMA WRITE and a second RDMA WRITE of a commit marker",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .slot_extra = MARKER_SIZE,
+    .send_ops = IBV_QP_EX_WITH_RDMA_WRITE,
+    .node_data = marker_node_data,
+    .prepare = commit_prepare,
+    .post = write_marker_post,
+    .poll = poll_sends,
+};
+
+const struct method write_marker_flush_method = {
+    .name = "write-marker-flush",
+    .description = "write-marker and an RDMA FLUSH of record and marker",
+    .send_wrs = 3,
+    .max_ranges = 1,
+    .slot_extra = MARKER_SIZE,
+    .access = FLUSH_ACCESS,
+    .send_ops = IBV_QP_EX_WITH_RDMA_WRITE | FLUSH_OPS,
+    .check = flush_check,
+    .node_data = marker_node_data,
+    .prepare = commit_prepare,
+    .post = write_marker_flush_post,
+    .poll = poll_sends,
+};
+
+const struct method write_atomic_marker_method = {
+    .name = "write-atomic-marker",
+    .description = "RDMA WRITE and an RDMA ATOMIC WRITE of a commit marker",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .slot_extra = MARKER_SIZE,
+    .send_ops = IBV_QP_EX_WITH_RDMA_WRITE | ATOMIC_WRITE_OPS,
+    .check = atomic_marker_check,
+    .node_data = marker_node_data,
+    .prepare = commit_prepare,
+    .post = write_atomic_marker_post,
+    .poll = poll_sends,
+};
+
+const struct method write_atomic_marker_flush_method = {
+    .name = "write-atomic-marker-flush",
+    .description = "write-atomic-marker and an RDMA FLUSH of record and marker",
+    .send_wrs = 3,
+    .max_ranges = 1,
+    .slot_extra = MARKER_SIZE,
+    .access = FLUSH_ACCESS,
+    .send_ops = IBV_QP_EX_WITH_RDMA_WRITE | ATOMIC_WRITE_OPS | FLUSH_OPS,
+    .check = atomic_marker_flush_check,
+    .node_data = marker_node_data,
+    .prepare = commit_prepare,
+    .post = write_atomic_marker_flush_post,
+    .poll = poll_sends,
+};
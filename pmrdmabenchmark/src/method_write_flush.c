@@ -0,0 +1,73 @@
+#include "pmbenchmark.h"
+
+// RDMA WRITE followed by an RDMA FLUSH of the written range, the IBTA
+// operation for remote persistence. The FLUSH executes once the writes
+// before it on the QP are placed, its completion tells the range is in the
+// server's persistence domain. No server CPU is involved, the buffer only
+// has to be registered with the flush access flags.
+//
+// FLUSH is only reachable through the ibv_wr_* calls of an extended QP and
+// only recent rdma-core has it, CMake defines HAVE_IBV_WR_FLUSH when the
+// verbs headers do.
+
+#ifdef HAVE_IBV_WR_FLUSH
+
+static void write_flush_prepare(struct benchmark_node *node) {
+  // the ibv_wr_* calls take every field per op, nothing to prefill
+  (void)node;
+}
+
+static int write_flush_post(struct benchmark_node *node, uint64_t seq, int n) {
+  struct ibv_qp_ex *qpx = node->qpx;
+  uint32_t rkey = node->server_metadata->key.remote_key;
+  uint64_t remote_addr;
+  int i;
+
+  ibv_wr_start(qpx);
+  for (i = 0; i < n; ++i) {
+    remote_addr = node->server_metadata->address + next_slot_offset(node);
+
+    qpx->wr_id = seq + i;
+    qpx->wr_flags = 0;
+    ibv_wr_rdma_write(qpx, rkey, remote_addr);
+    wr_set_message(node);
+
+    // flushes complete in order after their write, only they are signaled
+    qpx->wr_id = seq + i;
+    qpx->wr_flags = op_signal(seq + i);
+    ibv_wr_flush(qpx, rkey, remote_addr, message_size, IBV_FLUSH_PERSISTENT,
+                 IBV_FLUSH_RANGE);
+  }
+  return wr_complete(node);
+}
+
+const struct method write_flush_method = {
+    .name = "write-flush",
+    .description = "RDMA WRITE and an RDMA FLUSH of the range to persistence",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .access = IBV_ACCESS_FLUSH_PERSISTENT,
+    .send_ops = IBV_QP_EX_WITH_RDMA_WRITE | IBV_QP_EX_WITH_FLUSH,
+    .prepare = write_flush_prepare,
+    .post = write_flush_post,
+    .poll = poll_sends,
+};
+
+#else
+
+static int write_flush_check(void) {
+  printf("pmbenchmark: write-flush needs ibv_wr_flush, rebuild against an "
+         "rdma-core that has it\n");
+  return -1;
+}
+
+const struct method write_flush_method = {
+    .name = "write-flush",
+    .description = "RDMA WRITE and an RDMA FLUSH of the range to persistence "
+                   "(not built)",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .check = write_flush_check,
+};
+
+#endif
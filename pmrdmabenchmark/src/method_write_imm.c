@@ -0,0 +1,126 @@
+#include <arpa/inet.h>
+#include <libpmem.h>
+
+#include "pmbenchmark.h"
+
+// iGPRRM: one RDMA WRITE_WITH_IMM, the immediate names the range the server
+// persists before it replies
+
+// bits 31..12 of the immediate hold the offset and bits 11..0 the length
+// minus one, both in cache lines from the start of the connection's buffer
+#define IMM_LINE_SIZE 64
+#define IMM_LENGTH_BITS 12
+#define IMM_MAX_LINES (1u << IMM_LENGTH_BITS)
+#define IMM_MAX_OFFSET_LINES (1u << (32 - IMM_LENGTH_BITS))
+
+static uint32_t imm_encode(uint64_t offset, uint32_t length) {
+  uint32_t lines = (length + IMM_LINE_SIZE - 1) / IMM_LINE_SIZE;
+
+  return htonl((uint32_t)(offset / IMM_LINE_SIZE) << IMM_LENGTH_BITS |
+               (lines - 1));
+}
+
+static void imm_decode(uint32_t imm, uint64_t *offset, uint32_t *length) {
+  imm = ntohl(imm);
+  *offset = (uint64_t)(imm >> IMM_LENGTH_BITS) * IMM_LINE_SIZE;
+  *length = ((imm & (IMM_MAX_LINES - 1)) + 1) * IMM_LINE_SIZE;
+}
+
+// slots start on a cache line, so the immediate can address any of them
+static int write_imm_check(void) {
+  if (message_size > IMM_MAX_LINES * IMM_LINE_SIZE) {
+    printf("pmbenchmark: write-imm message size at most %u bytes\n",
+           IMM_MAX_LINES * IMM_LINE_SIZE);
+    return -1;
+  }
+  return 0;
+}
+
+static void write_imm_prepare(struct benchmark_node *node) {
+  int i;
+
+  // source, shared by all writes
+  node->send_sge[0].length = message_size;
+  node->send_sge[0].lkey = node->src_mem_mr->lkey;
+  node->send_sge[0].addr = (uintptr_t)node->src_mem;
+
+  for (i = 0; i < post_batch; ++i) {
+    node->send_wr[i].next = &node->send_wr[i + 1];
+    node->send_wr[i].sg_list = node->send_sge;
+    node->send_wr[i].num_sge = 1;
+    node->send_wr[i].opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+    node->send_wr[i].wr.rdma.rkey = node->server_metadata->key.remote_key;
+  }
+}
+
+static int write_imm_post(struct benchmark_node *node, uint64_t seq, int n) {
+  struct ibv_send_wr *wr = node->send_wr;
+  uint64_t offset;
+  int i, ret;
+
+  // replies are received in the order of the writes
+  ret = post_recv_replies(node, seq, n);
+  if (ret)
+    return ret;
+
+  for (i = 0; i < n; ++i) {
+    offset = next_slot_offset(node);
+    wr[i].send_flags = node->inline_flag | op_signal(seq + i);
+    wr[i].wr_id = seq + i;
+    wr[i].wr.rdma.remote_addr = node->server_metadata->address + offset;
+    wr[i].imm_data = imm_encode(offset, message_size);
+  }
+  return post_prepared(node, n, 1);
+}
+
+static int write_imm_post_wr(struct benchmark_node *node, uint64_t seq,
+                             int n) {
+  struct ibv_qp_ex *qpx = node->qpx;
+  uint64_t offset;
+  int i, ret;
+
+  ret = post_recv_replies(node, seq, n);
+  if (ret)
+    return ret;
+
+  ibv_wr_start(qpx);
+  for (i = 0; i < n; ++i) {
+    offset = next_slot_offset(node);
+    qpx->wr_id = seq + i;
+    qpx->wr_flags = op_signal(seq + i);
+    ibv_wr_rdma_write_imm(qpx, node->server_metadata->key.remote_key,
+                          node->server_metadata->address + offset,
+                          imm_encode(offset, message_size));
+    wr_set_message(node);
+  }
+  return wr_complete(node);
+}
+
+static uint8_t write_imm_serve(struct benchmark_node *node, struct ibv_wc *wc,
+                               void *request) {
+  uint64_t offset;
+  uint32_t length;
+
+  (void)request;
+  imm_decode(wc->imm_data, &offset, &length);
+  if (offset > node_buffer_size() || length > node_buffer_size() - offset)
+    return 1;
+  if (use_pmem)
+    pmem_flush((char *)node->mem + offset, length);
+  return 0;
+}
+
+const struct method write_imm_method = {
+    .name = "write-imm",
+    .description = "iGPRRM, RDMA WRITE_WITH_IMM naming the range to persist",
+    .send_wrs = 1,
+    .max_ranges = 1,
+    .max_buffer = (size_t)IMM_MAX_OFFSET_LINES * IMM_LINE_SIZE,
+    .check = write_imm_check,
+    .prepare = write_imm_prepare,
+    .post = write_imm_post,
+    .post_wr = write_imm_post_wr,
+    .wr_send_ops = IBV_QP_EX_WITH_RDMA_WRITE_WITH_IMM,
+    .poll = poll_replies,
+    .serve = write_imm_serve,
+};
@@ -0,0 +1,88 @@
+#include "pmbenchmark.h"
+
+// ARRM: an RDMA WRITE followed by a 0 byte RDMA READ of the same slot. The
+// read flushes the write out of the server's PCIe path, its completion
+// tells the data reached the persistence domain when DDIO is off.
+
+static void write_read_prepare(struct benchmark_node *node) {
+  struct ibv_send_wr *wr;
+  int i;
+
+  // write source
+  node->send_sge[0].length = message_size;
+  node->send_sge[0].lkey = node->src_mem_mr->lkey;
+  node->send_sge[0].addr = (uintptr_t)node->src_mem;
+
+  // read destination
+  node->send_sge[1].length = 0;
+  node->send_sge[1].lkey = node->src_mem_mr->lkey;
+  node->send_sge[1].addr = (uintptr_t)node->src_mem;
+
+  for (i = 0; i < 2 * post_batch; i += 2) {
+    wr = &node->send_wr[i];
+    wr[0].next = &wr[1];
+    wr[0].sg_list = &node->send_sge[0];
+    wr[0].num_sge = 1;
+    wr[0].opcode = IBV_WR_RDMA_WRITE;
+    wr[0].send_flags = node->inline_flag;
+    wr[0].wr.rdma.rkey = node->server_metadata->key.remote_key;
+
+    wr[1].next = &wr[2];
+    wr[1].sg_list = &node->send_sge[1];
+    wr[1].num_sge = 1;
+    wr[1].opcode = IBV_WR_RDMA_READ;
+    wr[1].wr.rdma.rkey = node->server_metadata->key.remote_key;
+  }
+}
+
+static int write_read_post(struct benchmark_node *node, uint64_t seq, int n) {
+  struct ibv_send_wr *wr;
+  uint64_t remote_addr;
+  int i;
+
+  for (i = 0; i < n; ++i) {
+    wr = &node->send_wr[2 * i];
+    remote_addr = node->server_metadata->address + next_slot_offset(node);
+    wr[0].wr_id = seq + i;
+    wr[0].wr.rdma.remote_addr = remote_addr;
+    // reads complete in order after their write, only they are signaled
+    wr[1].send_flags = op_signal(seq + i);
+    wr[1].wr_id = seq + i;
+    wr[1].wr.rdma.remote_addr = remote_addr;
+  }
+  return post_prepared(node, n, 2);
+}
+
+static int write_read_post_wr(struct benchmark_node *node, uint64_t seq,
+                              int n) {
+  struct ibv_qp_ex *qpx = node->qpx;
+  uint32_t rkey = node->server_metadata->key.remote_key;
+  uint64_t remote_addr;
+  int i;
+
+  ibv_wr_start(qpx);
+  for (i = 0; i < n; ++i) {
+    remote_addr = node->server_metadata->address + next_slot_offset(node);
+    qpx->wr_id = seq + i;
+    qpx->wr_flags = 0;
+    ibv_wr_rdma_write(qpx, rkey, remote_addr);
+    wr_set_message(node);
+
+    qpx->wr_flags = op_signal(seq + i);
+    ibv_wr_rdma_read(qpx, rkey, remote_addr);
+    ibv_wr_set_sge(qpx, node->src_mem_mr->lkey, (uintptr_t)node->src_mem, 0);
+  }
+  return wr_complete(node);
+}
+
+const struct method write_read_method = {
+    .name = "write-read",
+    .description = "ARRM, RDMA WRITE and a 0 byte RDMA READ",
+    .send_wrs = 2,
+    .max_ranges = 1,
+    .prepare = write_read_prepare,
+    .post = write_read_post,
+    .post_wr = write_read_post_wr,
+    .wr_send_ops = IBV_QP_EX_WITH_RDMA_WRITE | IBV_QP_EX_WITH_RDMA_READ,
+    .poll = poll_sends,
+};
@@ -0,0 +1,140 @@
+#include <libpmem.h>
+
+#include "pmbenchmark.h"
+
+// GPRRM: the records are written with RDMA WRITE, then a SEND asks the
+// server to persist exactly their ranges and the op completes when the
+// server's reply arrives. Each record of an op takes the next slot of the
+// ring, so with -r above 1 the ranges lie apart, at line aligned offsets
+// in the order of -o, and the server flushes each on its own.
+
+#define MAX_FLUSH_RANGES 16
+
+struct __attribute((packed)) flush_range {
+  uint64_t address; // offset into the connection's server buffer
+  uint32_t length;
+};
+
+// only the first count ranges are sent, see flush_request_size()
+struct __attribute((packed)) flush_request {
+  uint32_t count;
+  struct flush_range ranges[MAX_FLUSH_RANGES];
+};
+
+static size_t flush_request_size(uint32_t count) {
+  return offsetof(struct flush_request, ranges) +
+         count * sizeof(struct flush_range);
+}
+
+// each op is flush_ranges writes and the SEND, the request of op k of the
+// batch is sent from node->requests[seq % iodepth]
+static void write_send_prepare(struct benchmark_node *node) {
+  struct flush_request *request;
+  struct ibv_send_wr *wr;
+  int i, k, op_wrs = flush_ranges + 1;
+
+  node->request_flag =
+      flush_request_size(flush_ranges) <= node->max_inline_data
+          ? IBV_SEND_INLINE
+          : 0;
+
+  // range lengths never change, the addresses are set per op
+  for (k = 0; k < iodepth; ++k) {
+    request = (struct flush_request *)(node->requests +
+                                       k * sizeof(struct flush_request));
+    request->count = flush_ranges;
+    for (i = 0; i < flush_ranges; ++i)
+      request->ranges[i].length = message_size;
+  }
+
+  // write source, shared by all records
+  node->send_sge[0].length = message_size;
+  node->send_sge[0].lkey = node->src_mem_mr->lkey;
+  node->send_sge[0].addr = (uintptr_t)node->src_mem;
+
+  for (k = 0; k < post_batch; ++k) {
+    wr = &node->send_wr[k * op_wrs];
+    for (i = 0; i < flush_ranges; ++i) {
+      wr[i].next = &wr[i + 1];
+      wr[i].sg_list = &node->send_sge[0];
+      wr[i].num_sge = 1;
+      wr[i].opcode = IBV_WR_RDMA_WRITE;
+      wr[i].send_flags = node->inline_flag;
+      wr[i].wr.rdma.rkey = node->server_metadata->key.remote_key;
+    }
+    node->send_sge[1 + k].length = flush_request_size(flush_ranges);
+    node->send_sge[1 + k].lkey = node->request_mr->lkey;
+    wr[i].next = &wr[i + 1];
+    wr[i].sg_list = &node->send_sge[1 + k];
+    wr[i].num_sge = 1;
+    wr[i].opcode = IBV_WR_SEND;
+  }
+}
+
+static int write_send_post(struct benchmark_node *node, uint64_t seq, int n) {
+  struct flush_request *request;
+  struct ibv_send_wr *wr;
+  int i, k, ret, op_wrs = flush_ranges + 1;
+
+  // replies are received in the order of the requests
+  ret = post_recv_replies(node, seq, n);
+  if (ret)
+    return ret;
+
+  for (k = 0; k < n; ++k) {
+    wr = &node->send_wr[k * op_wrs];
+    request = (struct flush_request *)(node->requests +
+                                       (seq + k) % iodepth *
+                                           sizeof(struct flush_request));
+    for (i = 0; i < flush_ranges; ++i) {
+      request->ranges[i].address = next_slot_offset(node);
+      wr[i].wr_id = seq + k;
+      wr[i].wr.rdma.remote_addr =
+          node->server_metadata->address + request->ranges[i].address;
+    }
+    node->send_sge[1 + k].addr = (uintptr_t)request;
+    wr[i].send_flags = node->request_flag | op_signal(seq + k);
+    wr[i].wr_id = seq + k;
+  }
+  return post_prepared(node, n, op_wrs);
+}
+
+// flushes exactly the requested ranges, the drain is shared by the batch;
+// returns the notification status, > 0 if a range lies outside the
+// connection's buffer
+static uint8_t write_send_serve(struct benchmark_node *node, struct ibv_wc *wc,
+                                void *buffer) {
+  struct flush_request *request = buffer;
+  struct flush_range *range;
+  uint32_t i;
+
+  (void)wc;
+  if (request->count > MAX_FLUSH_RANGES)
+    return 1;
+  for (i = 0; i < request->count; ++i) {
+    range = &request->ranges[i];
+    if (range->address > node_buffer_size() ||
+        range->length > node_buffer_size() - range->address)
+      return 1;
+  }
+
+  if (use_pmem) {
+    for (i = 0; i < request->count; ++i) {
+      range = &request->ranges[i];
+      pmem_flush((char *)node->mem + range->address, range->length);
+    }
+  }
+  return 0;
+}
+
+const struct method write_send_method = {
+    .name = "write-send",
+    .description = "GPRRM, RDMA WRITE and a SEND of the ranges to persist",
+    .send_wrs = 2,
+    .max_ranges = MAX_FLUSH_RANGES,
+    .request_size = sizeof(struct flush_request),
+    .prepare = write_send_prepare,
+    .post = write_send_post,
+    .poll = poll_replies,
+    .serve = write_send_serve,
+};
@@ -0,0 +1,2904 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libpmem.h>
+#include <math.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pmbenchmark.h"
+
+// programs built from this engine under the old names pick their method
+#ifndef DEFAULT_METHOD
+#define DEFAULT_METHOD "write"
+#endif
+
+struct benchmark {
+  struct rdma_event_channel *channel;
+  struct benchmark_node *nodes;
+  pthread_t *threads;
+  struct ibv_cq *shared_cq[2]; // used by all QPs when shared_cq_pollers > 0
+
+  // shared receive queue mode, all QPs share one PD and one SRQ
+  struct ibv_pd *pd;
+  struct ibv_srq *srq;
+  struct ibv_mr *srq_buff_mr;
+  char *srq_buff;
+  int *srq_free; // consumed receives waiting for srq_watermark()
+  int srq_free_count;
+  pthread_mutex_t srq_lock;
+  pthread_t srq_thread;
+  // connections by QP number, open addressing, a power of two of slots
+  struct benchmark_node **qp_nodes;
+  unsigned qp_nodes_mask;
+  int conn_index;
+  int connects_left;
+  int disconnects_left;
+
+  struct rdma_addrinfo *rai;
+};
+
+static const struct method *methods[] = {
+    &write_method,     &write_read_method, &write_send_method,
+    &write_imm_method, &read_method,       &fetch_add_method,
+    &fetch_add_read_method, &cmp_swap_method, &cmp_swap_read_method,
+    &write_flush_method,    &write_marker_method,
+    &write_marker_flush_method, &write_atomic_marker_method,
+    &write_atomic_marker_flush_method, &send_copy_method,
+    &log_append_method,
+};
+
+static struct benchmark test;
+static const struct method *method;
+static struct method wr_method; // method with its ibv_wr_* path, --wr-api
+static bool wr_api = false; // client: ibv_wr_* posting and a cq_ex
+static bool hw_timestamps = false; // client: NIC completion times as well
+static enum CQ_INDEX ts_cq; // client: the CQ an op completes on
+static int ts_wallclock = -1; // client: clock kind of all timestamped CQs
+static int connections = 1;
+#define DEFAULT_MESSAGE_SIZE 100
+// RNR retries of the client QP, 7 retries forever; an SRQ that runs empty
+// then delays the sender with RNR NAKs instead of failing its QP
+#define RNR_RETRY_COUNT 7
+unsigned message_size; // 0 until -S, methods may pick their own
+int iodepth = 1;
+int signal_interval = 1;
+int post_batch = 1;
+int flush_ranges = 1; // records written and persisted per op
+static double rate = 0; // open loop ops/s per connection, 0 is closed loop
+static enum arrival arrival = ARRIVAL_CONSTANT;
+static bool ring_layout = false; // server: slot ring over the whole mapping
+static enum slot_order slot_order = SLOT_SEQUENTIAL;
+static int slots = 1; // server: slots per connection in the fixed layout
+static int shared_cq_pollers = 0;
+static int recv_batch = MAX_POLL_BATCH; // server: requests per poll and drain
+static int server_threads = 0; // server: pool size, 0 is one per connection
+static int spin_us = 50; // server: longest poll of idle connections
+static atomic_bool server_stop = false;
+static int stop_fd = -1; // server: eventfd that wakes sleeping threads
+bool atomic_contended = false; // client: all connections on the shared line
+static void *shared_line; // server: the line of method->shared_word
+static void *log_buffer; // server: the DRAM buffer of method->shared_log
+static unsigned rd_atomic; // client: reads and atomics in flight per QP
+static int srq_size = 0; // receives pre-posted in the SRQ, 0 disables it
+static int series_interval = 0; // ms between time series lines, 0 disables
+static bool series_json = false;
+static atomic_bool series_stop = false;
+static pthread_t series_thread;
+static uint64_t warmup_ops = 0;  // ops per connection before measuring
+static int warmup_window = 0;    // ms, steady state detection window
+static double warmup_tolerance = 5; // % throughput change still steady
+static const char *port = "7471";
+static uint8_t set_tos = 0;
+static uint8_t tos;
+static char *dst_addr;
+static char *src_addr;
+static struct rdma_addrinfo hints;
+static uint8_t set_timeout;
+static uint8_t timeout;
+static size_t metadata_size = sizeof(struct rdma_buffer_attr);
+static size_t pmem_mapped_len;
+static uint32_t inline_size = 256; // requested, 0 disables inlining
+uint32_t max_inline_data;          // granted to the last QP, reported
+int is_pmem;
+atomic_bool begin = false;
+atomic_bool stop = false;
+atomic_bool measure = false; // warm-up is over
+bool use_pmem = false;
+struct timespec sleep_time;
+struct timespec prepare_time;
+struct statistics total_stats;
+uint64_t warmup_nanoseconds;
+uint64_t warmup_excluded; // ops done during warm-up
+bool warmup_steady;
+char pmem_file_path[128] = {0};
+bool debug_log = true;
+bool csv_output = false;
+void *pmem;
+
+// wakes every server thread, they return at the top of their loop
+static void stop_server(void) {
+  server_stop = true;
+  if (stop_fd >= 0)
+    eventfd_write(stop_fd, 1);
+}
+
+// bytes written or read per op, one record per range
+size_t op_size(void) { return (size_t)message_size * flush_ranges; }
+
+// a slot holds the records of one op and what the method writes after
+// them, it starts on a cache line
+size_t slot_size(void) {
+  return (op_size() + method->slot_extra + SLOT_ALIGN - 1) / SLOT_ALIGN *
+         SLOT_ALIGN;
+}
+
+// server: the shared line sits at the start of the mapping, before the
+// buffers of the connections
+static size_t shared_bytes(void) { return method->shared_word ? SLOT_ALIGN : 0; }
+
+// records of a shared log in DRAM at least, -l may ask for more
+#define MIN_LOG_RECORDS 1024
+
+// records of a shared log in DRAM: -l, but room for twice the appends of
+// all connections in flight, truncation frees half of the log at a time
+static size_t log_records(void) {
+  size_t records = 2 * (size_t)iodepth * connections;
+
+  if (records < MIN_LOG_RECORDS)
+    records = MIN_LOG_RECORDS;
+  return (size_t)slots > records ? (size_t)slots : records;
+}
+
+// bytes of the server buffer of one connection, capped to what the method
+// can address
+size_t node_buffer_size(void) {
+  size_t size;
+
+  // a shared log fills the mapping, in DRAM it holds log_records()
+  if (method->shared_log)
+    size = use_pmem ? (pmem_mapped_len - shared_bytes()) / SLOT_ALIGN *
+                          SLOT_ALIGN
+                    : slot_size() * log_records();
+  else if (ring_layout)
+    size = slot_ring_share(pmem_mapped_len - shared_bytes(), connections,
+                           slot_size());
+  else
+    size = slot_size() * slots;
+  if (method->max_buffer && size > method->max_buffer)
+    size = method->max_buffer / slot_size() * slot_size();
+  return size;
+}
+
+// server receive buffer of a request, the records of the op follow the
+// method's request when it sends them as payload
+static size_t request_bytes(void) {
+  return method->request_size + (method->request_payload ? op_size() : 0);
+}
+
+// scatter entries of a client work request, a request and its payload
+static int send_sges(void) { return method->request_payload ? 2 : 1; }
+
+// work requests of one op on the client send queue
+static int op_wrs(void) { return method->send_wrs + flush_ranges - 1; }
+
+// requests a client may have in flight whose replies arrived before their
+// send completions were reaped, so the send queue holds two windows
+static int send_queue_depth(void) {
+  return (2 * iodepth + signal_interval) * op_wrs();
+}
+
+uint64_t get_cpu_time_ns() {
+  struct timespec spec;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &spec);
+  return (uint64_t)spec.tv_sec * (1000 * 1000 * 1000) + (uint64_t)spec.tv_nsec;
+}
+
+// an open loop run or a long warm-up can end with no measured op, or one
+// and no jitter between ops
+static uint64_t per_op(uint64_t total, uint64_t ops) {
+  return ops ? total / ops : 0;
+}
+
+static uint64_t avg_jitter(struct statistics *stats) {
+  return stats->ops > 1 ? stats->jitter / (stats->ops - 1) : 0;
+}
+
+// the worker posts what the free slots allow, up to post_batch
+static double ops_per_doorbell(struct statistics *stats) {
+  return stats->doorbells ? (double)stats->posted / stats->doorbells : 0;
+}
+
+static void print_warmup(void) {
+  if (!warmup_ops && !warmup_window)
+    return;
+  puts("warm-up [ms] | ops excluded | end");
+  printf("%lu %lu %s\n", warmup_nanoseconds / 1000000, warmup_excluded,
+         warmup_ops      ? "op count"
+         : warmup_steady ? "steady"
+                         : "not steady, time limit");
+}
+
+static void print_stats(struct statistics *stats) {
+  if (csv_output) {
+    printf("%lu;%lu;%lu;%f;%f;%lu;%d;%d;%d;%d;%d", stats->ops,
+           per_op(stats->latency, stats->ops), avg_jitter(stats),
+           (double)stats->ops * op_size() / (1024 * 1024 * 1024) *
+               1000000000 / stats->elapsed_nanoseconds,
+           (double)stats->ops * 1000000000 / stats->elapsed_nanoseconds,
+           per_op(stats->cpu_nanoseconds, stats->ops), iodepth, post_batch,
+           signal_interval, message_size <= max_inline_data, flush_ranges);
+    printf(";%.0f;%lu;%.1f;%lu;%lu;%u;%d;%d;%lu;%lu;%.2f;%lu", rate,
+           stats->late, timer_overhead_ns(), warmup_nanoseconds / 1000000,
+           warmup_excluded, rd_atomic, atomic_contended,
+           method->send_ops != 0,
+           hw_timestamps ? per_op(stats->nic_latency, stats->ops) : 0,
+           stats->failed, ops_per_doorbell(stats),
+           per_op(timer_cycles(stats->cpu_nanoseconds), stats->ops));
+    hist_print_csv(&stats->hist);
+    putchar('\n');
+  } else {
+    printf("method %s: %s, posted with %s\n", method->name,
+           method->description,
+           method->send_ops ? "ibv_wr_*" : "ibv_post_send");
+    puts("ops | avg lat [ns] | avg jitter [ns] | throughput [GB/s] | "
+         "ops/s | cpu/op [ns] | iodepth | batch | signal | inline | ranges");
+    printf("%lu %lu %lu %f %f %lu %d %d %d %d %d\n", stats->ops,
+           per_op(stats->latency, stats->ops), avg_jitter(stats),
+           (double)stats->ops * op_size() / (1024 * 1024 * 1024) *
+               1000000000 / stats->elapsed_nanoseconds,
+           (double)stats->ops * 1000000000 / stats->elapsed_nanoseconds,
+           per_op(stats->cpu_nanoseconds, stats->ops), iodepth, post_batch,
+           signal_interval, message_size <= max_inline_data, flush_ranges);
+    printf("batch: %d requested, %.2f ops per doorbell\n", post_batch,
+           ops_per_doorbell(stats));
+    if (timer_use_tsc)
+      printf("cpu/op: %lu cycles\n",
+             per_op(timer_cycles(stats->cpu_nanoseconds), stats->ops));
+    printf("reads and atomics in flight per connection: %u of iodepth %d%s\n",
+           rd_atomic, iodepth, atomic_contended ? ", contended" : "");
+    if (method->swaps)
+      printf("failed compare and swap: %lu of %lu ops, %.1f%%\n",
+             stats->failed, stats->ops,
+             stats->ops ? 100.0 * stats->failed / stats->ops : 0);
+    hist_print(&stats->hist);
+    if (hw_timestamps) {
+      printf("NIC completion latency, %s clock: avg %lu ns, host overhead "
+             "avg %lu ns\n",
+             ts_wallclock > 0 ? "wall" : "HCA",
+             per_op(stats->nic_latency, stats->ops),
+             per_op(stats->latency - stats->nic_latency, stats->ops));
+      hist_print(&stats->nic_hist);
+    }
+    pacer_print(rate, arrival, stats->ops, stats->late);
+    timer_print();
+    print_warmup();
+  }
+}
+
+static void node_print_stats(struct benchmark_node *node) {
+  puts("th | ops | time [ns] | avg lat [ns] | avg jitter [ns] | throughput "
+       "[GB/s] | cpu/op [ns]");
+  printf("%d %lu %lu %lu %lu %f %lu\n", node->id, node->stats->ops,
+         node->stats->elapsed_nanoseconds,
+         per_op(node->stats->latency, node->stats->ops),
+         avg_jitter(node->stats),
+         (double)node->stats->ops * op_size() / (1024 * 1024 * 1024) *
+             1000000000 / node->stats->elapsed_nanoseconds,
+         per_op(node->stats->cpu_nanoseconds, node->stats->ops));
+}
+
+static void print_metadata(struct benchmark_node *node) {
+  if (debug_log)
+    printf("Server addr:len:key:depth for node %d > %lu:%lu:%u:%u\n", node->id,
+           node->server_metadata->address, node->server_metadata->length,
+           node->server_metadata->key.local_key,
+           node->server_metadata->recv_depth);
+}
+
+// server: the target buffer, client: the source of writes and destination
+// of reads
+static int create_message(struct benchmark_node *node) {
+  if (dst_addr) {
+    node->src_mem = malloc(message_size);
+    if (!node->src_mem) {
+      printf("failed src_mem allocation\n");
+      return -1;
+    }
+    node->src_mem_mr = ibv_reg_mr(node->pd, node->src_mem, message_size,
+                                  IBV_ACCESS_LOCAL_WRITE);
+    if (!node->src_mem_mr) {
+      printf("failed to reg MR\n");
+      return -1;
+    }
+    return 0;
+  }
+
+  if (use_pmem) {
+    node->mem = (char *)pmem + shared_bytes() +
+                (method->shared_log ? 0 : node_buffer_size() * node->id);
+    if (!is_pmem) {
+      printf("error: not pmem\n");
+      return -1;
+    }
+  } else if (method->shared_log) {
+    node->mem = log_buffer;
+  } else {
+    node->mem = malloc(node_buffer_size());
+    if (!node->mem) {
+      printf("failed message allocation\n");
+      return -1;
+    }
+  }
+
+  node->mr = ibv_reg_mr(node->pd, node->mem, node_buffer_size(),
+                        (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ |
+                         IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC |
+                         method->access));
+  if (!node->mr) {
+    printf("failed to reg MR errno %d\n", errno);
+    return -1;
+  }
+
+  if (!method->shared_word)
+    return 0;
+  // registered once per connection, the PDs differ without an SRQ
+  node->shared_mr = ibv_reg_mr(node->pd, shared_line, SLOT_ALIGN,
+                               (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ |
+                                IBV_ACCESS_REMOTE_WRITE |
+                                IBV_ACCESS_REMOTE_ATOMIC));
+  if (!node->shared_mr) {
+    printf("failed to reg shared MR errno %d\n", errno);
+    return -1;
+  }
+  return 0;
+}
+
+static void server_set_metadata(struct benchmark_node *node) {
+  node->server_metadata->address = (uint64_t)node->mr->addr;
+  node->server_metadata->length = node->mr->length;
+  node->server_metadata->key.local_key = node->mr->rkey;
+  node->server_metadata->recv_depth = srq_size ? srq_size : iodepth;
+  node->server_metadata->reply_depth = iodepth;
+  if (node->shared_mr) {
+    node->server_metadata->shared_address = (uint64_t)node->shared_mr->addr;
+    node->server_metadata->shared_key = node->shared_mr->rkey;
+  }
+  print_metadata(node);
+}
+
+static int create_metadata(struct benchmark_node *node) {
+  node->server_metadata = calloc(metadata_size, 1);
+  if (!node->server_metadata) {
+    printf("failed server_metadata allocation\n");
+    return -1;
+  }
+  node->server_metadata_mr = ibv_reg_mr(node->pd, node->server_metadata,
+                                        metadata_size, IBV_ACCESS_LOCAL_WRITE);
+  if (!node->server_metadata_mr) {
+    printf("failed to reg server_metadata_mr\n");
+    return -1;
+  }
+  return 0;
+}
+
+// request and reply buffers of the methods the server serves, iodepth of
+// each; the server's requests come from the SRQ pool in SRQ mode
+static int create_request_buffers(struct benchmark_node *node) {
+  size_t size = request_bytes() * iodepth;
+
+  if (!method->serve)
+    return 0;
+
+  if (size && (dst_addr || !srq_size)) {
+    node->requests = calloc(size, 1);
+    if (!node->requests) {
+      printf("failed request buffer allocation\n");
+      return -1;
+    }
+    node->request_mr =
+        ibv_reg_mr(node->pd, node->requests, size, IBV_ACCESS_LOCAL_WRITE);
+    if (!node->request_mr) {
+      printf("failed to reg request_mr\n");
+      return -1;
+    }
+  }
+
+  size = sizeof(struct flush_notification) * iodepth;
+  node->replies = calloc(size, 1);
+  if (!node->replies) {
+    printf("failed reply buffer allocation\n");
+    return -1;
+  }
+  node->reply_mr =
+      ibv_reg_mr(node->pd, node->replies, size, IBV_ACCESS_LOCAL_WRITE);
+  if (!node->reply_mr) {
+    printf("failed to reg reply_mr\n");
+    return -1;
+  }
+  return 0;
+}
+
+// client: the method's own state, once the server's metadata arrived
+static int create_method_data(struct benchmark_node *node) {
+  size_t size, nic_bytes = 0;
+
+  if (!method->node_data)
+    return 0;
+  size = method->node_data(node, &nic_bytes);
+  if (!size)
+    return -EINVAL;
+  node->method_data = calloc(size, 1);
+  if (!node->method_data) {
+    printf("failed method state allocation\n");
+    return -ENOMEM;
+  }
+  if (!nic_bytes)
+    return 0;
+  node->method_mr = ibv_reg_mr(node->pd, node->method_data, nic_bytes,
+                               IBV_ACCESS_LOCAL_WRITE);
+  if (!node->method_mr) {
+    printf("failed to reg method state MR\n");
+    return -ENOMEM;
+  }
+  return 0;
+}
+
+// client: post timestamps and the work requests the method prepares
+static int create_work_requests(struct benchmark_node *node) {
+  int i, wrs = post_batch * op_wrs();
+
+  node->post_time = calloc(iodepth, sizeof(uint64_t));
+  if (hw_timestamps) {
+    node->nic_time = calloc(iodepth, sizeof(uint64_t));
+    if (!node->nic_time) {
+      printf("failed work request allocation\n");
+      return -1;
+    }
+  }
+  node->send_wr = calloc(wrs, sizeof(struct ibv_send_wr));
+  node->send_sge = calloc(wrs * send_sges() + 1, sizeof(struct ibv_sge));
+  node->recv_wr = calloc(post_batch, sizeof(struct ibv_recv_wr));
+  node->recv_sge = calloc(post_batch, sizeof(struct ibv_sge));
+  if (!node->post_time || !node->send_wr || !node->send_sge ||
+      !node->recv_wr || !node->recv_sge) {
+    printf("failed work request allocation\n");
+    return -1;
+  }
+
+  // replies land in node->replies[seq % iodepth], see post_recv_replies()
+  for (i = 0; i < post_batch; ++i) {
+    node->recv_wr[i].next = &node->recv_wr[i + 1];
+    node->recv_wr[i].sg_list = &node->recv_sge[i];
+    node->recv_wr[i].num_sge = 1;
+    node->recv_sge[i].length = sizeof(struct flush_notification);
+    node->recv_sge[i].lkey = node->reply_mr ? node->reply_mr->lkey : 0;
+  }
+  return 0;
+}
+
+// creates one send and one recv CQ shared by all connections, sized for the
+// work requests of every QP
+static int create_shared_cqs(struct ibv_context *verbs) {
+  int cqe = (iodepth + 1) * connections;
+
+  if (test.shared_cq[SEND_CQ_INDEX])
+    return 0;
+
+  test.shared_cq[SEND_CQ_INDEX] = ibv_create_cq(verbs, cqe, &test, NULL, 0);
+  test.shared_cq[RECV_CQ_INDEX] = ibv_create_cq(verbs, cqe, &test, NULL, 0);
+  if (!test.shared_cq[SEND_CQ_INDEX] || !test.shared_cq[RECV_CQ_INDEX]) {
+    printf("pmbenchmark: unable to create shared CQ\n");
+    return -ENOMEM;
+  }
+  return 0;
+}
+
+// posts n receives from the free list to the SRQ, linked in lists of
+// MAX_POLL_BATCH, caller holds srq_lock or runs before the server workers
+static int post_srq_recv(int *index, int n) {
+  struct ibv_recv_wr recv_wr[MAX_POLL_BATCH], *recv_failure;
+  struct ibv_sge sge[MAX_POLL_BATCH];
+  int i, k, ret = 0;
+
+  for (k = 0; k < n && !ret; k += MAX_POLL_BATCH) {
+    for (i = 0; i < MAX_POLL_BATCH && k + i < n; ++i) {
+      recv_wr[i].next =
+          i + 1 < MAX_POLL_BATCH && k + i + 1 < n ? &recv_wr[i + 1] : NULL;
+      recv_wr[i].sg_list = &sge[i];
+      recv_wr[i].num_sge = request_bytes() ? 1 : 0;
+      recv_wr[i].wr_id = index[k + i];
+
+      if (!request_bytes())
+        continue;
+      sge[i].length = request_bytes();
+      sge[i].lkey = test.srq_buff_mr->lkey;
+      sge[i].addr =
+          (uintptr_t)(test.srq_buff + index[k + i] * request_bytes());
+    }
+    ret = ibv_post_srq_recv(test.srq, recv_wr, &recv_failure);
+  }
+  if (ret)
+    printf("pmbenchmark: failed to post srq receive: %d\n", ret);
+  return ret;
+}
+
+// a quarter of the pool, the receives are re-posted in batches of it
+static int srq_watermark(void) { return srq_size / 4 ? srq_size / 4 : 1; }
+
+// arms the SRQ limit event, it fires once when fewer than srq_watermark()
+// receives are posted
+static int arm_srq_limit(void) {
+  struct ibv_srq_attr attr;
+
+  memset(&attr, 0, sizeof attr);
+  attr.srq_limit = srq_watermark();
+  return ibv_modify_srq(test.srq, &attr, IBV_SRQ_LIMIT);
+}
+
+// posts the whole free list, caller holds srq_lock
+static int srq_repost(void) {
+  int ret = 0;
+
+  if (test.srq_free_count)
+    ret = post_srq_recv(test.srq_free, test.srq_free_count);
+  if (!ret)
+    test.srq_free_count = 0;
+  return ret;
+}
+
+// returns a consumed receive to the free list and re-posts the list in bulk
+// once it holds srq_watermark() of them; the limit event alone could find
+// the list empty while the receives are being served and then never fire
+// again
+static void srq_release(int index) {
+  pthread_mutex_lock(&test.srq_lock);
+  test.srq_free[test.srq_free_count++] = index;
+  if (test.srq_free_count >= srq_watermark() && srq_repost())
+    printf("pmbenchmark: failed to replenish SRQ\n");
+  pthread_mutex_unlock(&test.srq_lock);
+}
+
+// replenishes the SRQ from the free list on IBV_EVENT_SRQ_LIMIT_REACHED
+// without waiting for the watermark, sleeps on the async event fd until the
+// server stops
+void *srq_event_worker(void *arg) {
+  struct ibv_context *verbs = arg;
+  struct ibv_async_event event;
+  struct pollfd fds[2] = {{.fd = verbs->async_fd, .events = POLLIN},
+                          {.fd = stop_fd, .events = POLLIN}};
+  int ret;
+
+  fcntl(verbs->async_fd, F_SETFL,
+        fcntl(verbs->async_fd, F_GETFL) | O_NONBLOCK);
+  while (!server_stop) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return NULL;
+    }
+    if (fds[1].revents)
+      break;
+    if (ibv_get_async_event(verbs, &event))
+      continue;
+    if (event.event_type == IBV_EVENT_SRQ_LIMIT_REACHED) {
+      pthread_mutex_lock(&test.srq_lock);
+      ret = srq_repost();
+      pthread_mutex_unlock(&test.srq_lock);
+      if (ret || arm_srq_limit())
+        printf("pmbenchmark: failed to replenish SRQ\n");
+    }
+    ibv_ack_async_event(&event);
+  }
+  return NULL;
+}
+
+// creates the PD and SRQ shared by all connections and pre-posts the pool
+static int create_srq(struct ibv_context *verbs) {
+  struct ibv_srq_init_attr srq_attr;
+  int i, ret;
+
+  if (test.srq)
+    return 0;
+
+  test.pd = ibv_alloc_pd(verbs);
+  if (!test.pd) {
+    printf("pmbenchmark: unable to allocate shared PD\n");
+    return -ENOMEM;
+  }
+
+  memset(&srq_attr, 0, sizeof srq_attr);
+  srq_attr.attr.max_wr = srq_size;
+  srq_attr.attr.max_sge = 1;
+  test.srq = ibv_create_srq(test.pd, &srq_attr);
+  if (!test.srq) {
+    perror("pmbenchmark: unable to create SRQ");
+    return -ENOMEM;
+  }
+
+  if (request_bytes()) {
+    test.srq_buff = calloc(srq_size, request_bytes());
+    if (!test.srq_buff) {
+      printf("pmbenchmark: failed srq_buff allocation\n");
+      return -ENOMEM;
+    }
+    test.srq_buff_mr = ibv_reg_mr(test.pd, test.srq_buff,
+                                  request_bytes() * srq_size,
+                                  IBV_ACCESS_LOCAL_WRITE);
+    if (!test.srq_buff_mr) {
+      printf("pmbenchmark: failed to reg srq_buff_mr\n");
+      return -ENOMEM;
+    }
+  }
+
+  for (i = 2; i < 2 * connections; i *= 2)
+    ;
+  test.qp_nodes = calloc(i, sizeof *test.qp_nodes);
+  if (!test.qp_nodes) {
+    printf("pmbenchmark: failed qp_nodes allocation\n");
+    return -ENOMEM;
+  }
+  test.qp_nodes_mask = i - 1;
+
+  test.srq_free = calloc(srq_size, sizeof(int));
+  if (!test.srq_free) {
+    printf("pmbenchmark: failed srq_free allocation\n");
+    return -ENOMEM;
+  }
+  pthread_mutex_init(&test.srq_lock, NULL);
+
+  // the whole pool starts posted
+  for (i = 0; i < srq_size; ++i)
+    test.srq_free[i] = i;
+  ret = post_srq_recv(test.srq_free, srq_size);
+  if (ret)
+    return ret;
+
+  ret = arm_srq_limit();
+  if (ret) {
+    printf("pmbenchmark: unable to arm SRQ limit: %d\n", ret);
+    return ret;
+  }
+  return pthread_create(&test.srq_thread, NULL, srq_event_worker, verbs);
+}
+
+// takes a new reference point of the node's clock, the first one also
+// fixes the start of the tick rate measurement
+static int hw_clock_sync(struct benchmark_node *node) {
+  struct hw_clock *clock = &node->clock;
+  struct ibv_values_ex values;
+  struct timespec wall;
+  uint64_t before, after, ticks;
+  int ret;
+
+  memset(&values, 0, sizeof values);
+  values.comp_mask = IBV_VALUES_MASK_RAW_CLOCK;
+  before = get_time_ns();
+  if (clock->wallclock)
+    ret = clock_gettime(CLOCK_REALTIME, &wall);
+  else
+    ret = ibv_query_rt_values_ex(node->cma_id->verbs, &values);
+  after = get_time_ns();
+  if (ret)
+    return ret;
+
+  clock->ns = before + (after - before) / 2;
+  if (clock->wallclock) {
+    clock->wall_offset = clock->ns - ((int64_t)wall.tv_sec * 1000000000 +
+                                      wall.tv_nsec);
+    return 0;
+  }
+  ticks = (uint64_t)values.raw_clock.tv_sec * 1000000000 +
+          values.raw_clock.tv_nsec;
+  if (!clock->first_ns) {
+    clock->first_ns = clock->ns;
+    clock->first_ticks = ticks;
+  } else if (ticks != clock->first_ticks) {
+    clock->ns_per_tick =
+        (double)(clock->ns - clock->first_ns) / (ticks - clock->first_ticks);
+  }
+  clock->ticks = ticks;
+  return 0;
+}
+
+// HCA and host clocks drift apart by a few us per second
+#define HW_CLOCK_SYNC_NS 100000000
+
+// the NIC's completion time of the current CQE in get_time_ns() time
+static uint64_t hw_completion_ns(struct benchmark_node *node,
+                                 struct ibv_cq_ex *cq) {
+  struct hw_clock *clock = &node->clock;
+  uint64_t ns;
+
+  if (clock->wallclock)
+    ns = ibv_wc_read_completion_wallclock_ns(cq) + clock->wall_offset;
+  else
+    ns = clock->ns + (int64_t)(ibv_wc_read_completion_ts(cq) - clock->ticks) *
+                         clock->ns_per_tick;
+  if ((int64_t)(ns - clock->ns) > HW_CLOCK_SYNC_NS)
+    hw_clock_sync(node);
+  return ns;
+}
+
+// wall clock timestamps where the device has them, else HCA ticks
+static struct ibv_cq_ex *timestamped_cq(struct benchmark_node *node,
+                                        struct ibv_cq_init_attr_ex *attr,
+                                        struct ibv_device_attr_ex *dev_attr) {
+  struct ibv_cq_ex *cq;
+
+  attr->wc_flags = IBV_WC_EX_WITH_COMPLETION_TIMESTAMP_WALLCLOCK;
+  cq = ibv_create_cq_ex(node->cma_id->verbs, attr);
+  if (cq) {
+    node->clock.wallclock = true;
+    if (!hw_clock_sync(node))
+      return cq;
+    ibv_destroy_cq(ibv_cq_ex_to_cq(cq));
+  }
+
+  memset(&node->clock, 0, sizeof node->clock);
+  if (!ibv_query_device_ex(node->cma_id->verbs, NULL, dev_attr) &&
+      dev_attr->hca_core_clock) {
+    attr->wc_flags = IBV_WC_EX_WITH_COMPLETION_TIMESTAMP;
+    cq = ibv_create_cq_ex(node->cma_id->verbs, attr);
+    if (cq) {
+      node->clock.ns_per_tick = 1000000.0 / dev_attr->hca_core_clock;
+      if (!hw_clock_sync(node))
+        return cq;
+      ibv_destroy_cq(ibv_cq_ex_to_cq(cq));
+    }
+  }
+  return NULL;
+}
+
+// a timestamped CQ, with wall clock times where the device has them, else
+// HCA ticks; 0 if it has neither. Every connection must end up with the
+// same kind of clock, the run reports one NIC latency for all of them.
+static struct ibv_cq_ex *create_timestamped_cq(struct benchmark_node *node,
+                                               struct ibv_cq_init_attr_ex *attr) {
+  struct ibv_device_attr_ex dev_attr;
+  struct ibv_cq_ex *cq;
+
+  cq = timestamped_cq(node, attr, &dev_attr);
+  if (!cq) {
+    printf("pmbenchmark: no completion timestamps on this device, run "
+           "without --hw-timestamps\n");
+    return NULL;
+  }
+  if (ts_wallclock < 0)
+    ts_wallclock = node->clock.wallclock;
+  if (ts_wallclock != node->clock.wallclock) {
+    printf("pmbenchmark: connections timestamp with both wall and HCA "
+           "clocks\n");
+    ibv_destroy_cq(ibv_cq_ex_to_cq(cq));
+    return NULL;
+  }
+  return cq;
+}
+
+
+// client CQs of --wr-api and --hw-timestamps: the extended ones are polled
+// with ibv_start_poll()/ibv_next_poll(), everything else keeps using them
+// through ibv_poll_cq()
+static int create_client_cqs(struct benchmark_node *node, int send_depth,
+                             int recv_depth) {
+  struct ibv_cq_init_attr_ex attr;
+  enum CQ_INDEX index;
+
+  for (index = SEND_CQ_INDEX; index <= RECV_CQ_INDEX; ++index) {
+    memset(&attr, 0, sizeof attr);
+    attr.cqe = index == SEND_CQ_INDEX ? send_depth : recv_depth;
+    attr.cq_context = node;
+    if (hw_timestamps && index == ts_cq) {
+      node->cq_ex[index] = create_timestamped_cq(node, &attr);
+      if (!node->cq_ex[index])
+        return -EOPNOTSUPP;
+    }
+    if (!node->cq_ex[index] && wr_api && index == SEND_CQ_INDEX)
+      node->cq_ex[index] = ibv_create_cq_ex(node->cma_id->verbs, &attr);
+
+    if (node->cq_ex[index])
+      node->cq[index] = ibv_cq_ex_to_cq(node->cq_ex[index]);
+    else
+      node->cq[index] =
+          ibv_create_cq(node->cma_id->verbs, attr.cqe, node, NULL, 0);
+    if (!node->cq[index])
+      return -ENOMEM;
+  }
+  return 0;
+}
+
+// the client QP of a method with extended send ops is created through
+// rdma_create_qp_ex so the method can post with the ibv_wr_* calls
+static int create_qp(struct benchmark_node *node,
+                     struct ibv_qp_init_attr *init_qp_attr) {
+  struct ibv_qp_init_attr_ex attr;
+  int ret;
+
+  if (!dst_addr || !method->send_ops)
+    return rdma_create_qp(node->cma_id, node->pd, init_qp_attr);
+
+  memset(&attr, 0, sizeof attr);
+  attr.qp_context = init_qp_attr->qp_context;
+  attr.send_cq = init_qp_attr->send_cq;
+  attr.recv_cq = init_qp_attr->recv_cq;
+  attr.srq = init_qp_attr->srq;
+  attr.cap = init_qp_attr->cap;
+  attr.qp_type = init_qp_attr->qp_type;
+  attr.sq_sig_all = init_qp_attr->sq_sig_all;
+  attr.comp_mask = IBV_QP_INIT_ATTR_PD | IBV_QP_INIT_ATTR_SEND_OPS_FLAGS;
+  attr.pd = node->pd;
+  attr.send_ops_flags = method->send_ops;
+  ret = rdma_create_qp_ex(node->cma_id, &attr);
+  if (ret)
+    return ret;
+
+  init_qp_attr->cap = attr.cap;
+  node->qpx = ibv_qp_to_qp_ex(node->cma_id->qp);
+  return 0;
+}
+
+// makes a server connection of SRQ mode known to node_by_qp_num(), the
+// pool threads may already be looking up other connections
+static void add_qp_node(struct benchmark_node *node) {
+  unsigned i = node->cma_id->qp->qp_num & test.qp_nodes_mask;
+
+  while (test.qp_nodes[i])
+    i = (i + 1) & test.qp_nodes_mask;
+  __atomic_store_n(&test.qp_nodes[i], node, __ATOMIC_RELEASE);
+}
+
+static int init_node(struct benchmark_node *node) {
+  struct ibv_qp_init_attr init_qp_attr;
+  int send_depth, recv_depth, ret;
+
+  node->stats = calloc(sizeof(struct statistics), 1);
+  if (!node->stats) {
+    ret = -ENOMEM;
+    printf("pmbenchmark: unable to allocate statistics errno: %d", errno);
+    goto out;
+  }
+  if (!dst_addr && method->serve) {
+    node->server_stats = calloc(sizeof(struct server_statistics), 1);
+    if (!node->server_stats) {
+      ret = -ENOMEM;
+      printf("pmbenchmark: unable to allocate server statistics\n");
+      goto out;
+    }
+  }
+
+  if (srq_size) {
+    ret = create_srq(node->cma_id->verbs);
+    if (ret)
+      goto out;
+    node->pd = test.pd;
+  } else {
+    node->pd = ibv_alloc_pd(node->cma_id->verbs);
+  }
+  if (!node->pd) {
+    ret = -ENOMEM;
+    printf("pmbenchmark: unable to allocate PD\n");
+    goto out;
+  }
+
+  // client: the ops in flight and the metadata, server: one reply per
+  // request in flight and the metadata
+  if (dst_addr) {
+    send_depth = send_queue_depth();
+    recv_depth = iodepth + 1;
+  } else {
+    send_depth = iodepth + 1;
+    recv_depth = iodepth;
+  }
+
+  if (shared_cq_pollers) {
+    ret = create_shared_cqs(node->cma_id->verbs);
+    if (ret)
+      goto out;
+    node->cq[SEND_CQ_INDEX] = test.shared_cq[SEND_CQ_INDEX];
+    node->cq[RECV_CQ_INDEX] = test.shared_cq[RECV_CQ_INDEX];
+  } else if (dst_addr && (wr_api || hw_timestamps)) {
+    ret = create_client_cqs(node, send_depth, recv_depth);
+    if (ret) {
+      printf("pmbenchmark: unable to create CQ\n");
+      goto out;
+    }
+  } else {
+    // the server pool sleeps on the requests' completion channel
+    if (!dst_addr && method->serve) {
+      node->channel = ibv_create_comp_channel(node->cma_id->verbs);
+      if (!node->channel) {
+        ret = -ENOMEM;
+        printf("pmbenchmark: unable to create completion channel\n");
+        goto out;
+      }
+      fcntl(node->channel->fd, F_SETFL,
+            fcntl(node->channel->fd, F_GETFL) | O_NONBLOCK);
+    }
+    node->cq[SEND_CQ_INDEX] =
+        ibv_create_cq(node->cma_id->verbs, send_depth, node, NULL, 0);
+    node->cq[RECV_CQ_INDEX] = ibv_create_cq(node->cma_id->verbs, recv_depth,
+                                            node, node->channel, 0);
+  }
+  if (!node->cq[SEND_CQ_INDEX] || !node->cq[RECV_CQ_INDEX]) {
+    ret = -ENOMEM;
+    printf("pmbenchmark: unable to create CQ\n");
+    goto out;
+  }
+
+  memset(&init_qp_attr, 0, sizeof init_qp_attr);
+  init_qp_attr.cap.max_send_wr = send_depth;
+  init_qp_attr.cap.max_recv_wr = recv_depth;
+  init_qp_attr.cap.max_send_sge = send_sges();
+  init_qp_attr.cap.max_inline_data = inline_size;
+  init_qp_attr.cap.max_recv_sge = 1;
+  init_qp_attr.qp_context = node;
+  init_qp_attr.sq_sig_all = 0;
+  init_qp_attr.qp_type = IBV_QPT_RC;
+  init_qp_attr.send_cq = node->cq[SEND_CQ_INDEX];
+  init_qp_attr.recv_cq = node->cq[RECV_CQ_INDEX];
+  init_qp_attr.srq = test.srq;
+  ret = create_qp(node, &init_qp_attr);
+  if (ret && inline_size) {
+    // device can't inline that much, fall back to DMA reads of the payload
+    init_qp_attr.cap.max_inline_data = 0;
+    ret = create_qp(node, &init_qp_attr);
+  }
+  if (ret) {
+    perror("pmbenchmark: unable to create QP");
+    goto out;
+  }
+
+  node->max_inline_data = max_inline_data = init_qp_attr.cap.max_inline_data;
+  if (test.srq)
+    add_qp_node(node);
+  if (debug_log)
+    printf("pmbenchmark: max inline data %u bytes\n", max_inline_data);
+
+  // allocate metadata buffer and mr
+  ret = create_metadata(node);
+  if (ret) {
+    printf("pmbenchmark: failed to create metadata buffer: %d\n", ret);
+    goto out;
+  }
+
+  ret = create_request_buffers(node);
+  if (ret) {
+    printf("pmbenchmark: failed to create request buffers: %d\n", ret);
+    goto out;
+  }
+
+  // allocate buffer and create message MR
+  ret = create_message(node);
+  if (ret) {
+    printf("pmbenchmark: failed to create messages: %d\n", ret);
+    goto out;
+  }
+
+  if (dst_addr) {
+    ret = create_work_requests(node);
+    if (ret)
+      printf("pmbenchmark: failed to create work requests: %d\n", ret);
+  }
+out:
+  return ret;
+}
+
+static int post_recv_metadata(struct benchmark_node *node) {
+  struct ibv_recv_wr recv_wr, *recv_failure;
+  struct ibv_sge sge;
+  int ret = 0;
+
+  recv_wr.next = NULL;
+  recv_wr.sg_list = &sge;
+  recv_wr.num_sge = 1;
+  recv_wr.wr_id = (uintptr_t)node;
+
+  sge.length = metadata_size;
+  sge.lkey = node->server_metadata_mr->lkey;
+  sge.addr = (uintptr_t)node->server_metadata;
+
+  ret = ibv_post_recv(node->cma_id->qp, &recv_wr, &recv_failure);
+  if (ret) {
+    printf("failed to post receive metadata: %d\n", ret);
+  }
+
+  return ret;
+}
+
+// server: receive into request buffer index of the connection, wr_id lets
+// shared CQ pollers find both
+static int post_recv_request(struct benchmark_node *node, int index) {
+  struct ibv_recv_wr recv_wr, *recv_failure;
+  struct ibv_sge sge;
+  int ret = 0;
+
+  recv_wr.next = NULL;
+  recv_wr.sg_list = &sge;
+  recv_wr.num_sge = request_bytes() ? 1 : 0;
+  recv_wr.wr_id = (uint64_t)node->id * iodepth + index;
+
+  sge.length = request_bytes();
+  sge.lkey = node->request_mr ? node->request_mr->lkey : 0;
+  sge.addr = (uintptr_t)(node->requests + index * request_bytes());
+
+  ret = ibv_post_recv(node->cma_id->qp, &recv_wr, &recv_failure);
+  if (ret) {
+    printf("failed to post receive request: %d\n", ret);
+  }
+
+  return ret;
+}
+
+// client: receives for the replies to ops seq to seq + n - 1
+int post_recv_replies(struct benchmark_node *node, uint64_t seq, int n) {
+  struct ibv_recv_wr *last = &node->recv_wr[n - 1], *recv_failure;
+  int i, ret;
+
+  for (i = 0; i < n; ++i) {
+    node->recv_wr[i].wr_id = seq + i;
+    node->recv_sge[i].addr = (uintptr_t)&node->replies[(seq + i) % iodepth];
+  }
+  last->next = NULL;
+  ret = ibv_post_recv(node->cma_id->qp, node->recv_wr, &recv_failure);
+  last->next = last + 1;
+  if (ret)
+    printf("failed to post receive reply: %d\n", ret);
+  return ret;
+}
+
+static int post_send_metadata(struct benchmark_node *node) {
+  struct ibv_send_wr send_wr, *bad_send_wr;
+  struct ibv_sge sge;
+  int ret = 0;
+
+  if (!node->connected)
+    return 0;
+
+  send_wr.next = NULL;
+  send_wr.sg_list = &sge;
+  send_wr.num_sge = 1;
+  send_wr.opcode = IBV_WR_SEND;
+  send_wr.send_flags = IBV_SEND_SIGNALED;
+  send_wr.wr_id = (unsigned long)node;
+
+  sge.length = metadata_size;
+  sge.lkey = node->server_metadata_mr->lkey;
+  sge.addr = (uintptr_t)node->server_metadata;
+
+  if (sge.length <= node->max_inline_data)
+    send_wr.send_flags |= IBV_SEND_INLINE;
+
+  ret = ibv_post_send(node->cma_id->qp, &send_wr, &bad_send_wr);
+  if (ret)
+    printf("failed to post send metadata: %d\n", ret);
+  return ret;
+}
+
+// replies go out of a ring of iodepth buffers, advertised as reply_depth;
+// a client never has more requests in flight so a buffer is free again when
+// it comes around, also when --srq lets the server take more requests
+static int post_send_reply(struct benchmark_node *node, uint8_t status) {
+  struct ibv_send_wr send_wr, *bad_send_wr;
+  struct ibv_sge sge;
+  struct flush_notification *reply;
+  int ret = 0;
+
+  if (!node->connected)
+    return 0;
+
+  reply = &node->replies[atomic_fetch_add(&node->replies_sent, 1) % iodepth];
+  reply->status = status;
+
+  send_wr.next = NULL;
+  send_wr.sg_list = &sge;
+  send_wr.num_sge = 1;
+  send_wr.opcode = IBV_WR_SEND;
+  send_wr.send_flags = IBV_SEND_SIGNALED;
+  send_wr.wr_id = node->id;
+
+  sge.length = sizeof(struct flush_notification);
+  sge.lkey = node->reply_mr->lkey;
+  sge.addr = (uintptr_t)reply;
+
+  if (sge.length <= node->max_inline_data)
+    send_wr.send_flags |= IBV_SEND_INLINE;
+
+  ret = ibv_post_send(node->cma_id->qp, &send_wr, &bad_send_wr);
+  if (ret)
+    printf("failed to post send reply: %d\n", ret);
+  return ret;
+}
+
+static void connect_error(void) { test.connects_left--; }
+
+static int addr_handler(struct benchmark_node *node) {
+  int ret;
+
+  if (set_tos) {
+    ret = rdma_set_option(node->cma_id, RDMA_OPTION_ID, RDMA_OPTION_ID_TOS,
+                          &tos, sizeof tos);
+    if (ret)
+      perror("pmbenchmark: set TOS option failed");
+  }
+  ret = rdma_resolve_route(node->cma_id, 2000);
+  if (ret) {
+    perror("pmbenchmark: resolve route failed");
+    connect_error();
+  }
+  return ret;
+}
+
+// client event
+static int route_handler(struct benchmark_node *node) {
+  struct rdma_conn_param conn_param;
+  struct ibv_device_attr attr;
+  int ret;
+
+  ret = init_node(node);
+  if (ret)
+    goto err;
+
+  ret = post_recv_metadata(node);
+  if (ret)
+    goto err;
+
+  ret = ibv_query_device(node->cma_id->verbs, &attr);
+  if (ret) {
+    perror("pmbenchmark: failure querying device");
+    goto err;
+  }
+
+  memset(&conn_param, 0, sizeof conn_param);
+  conn_param.responder_resources = 1;
+  // reads and atomics the QP keeps in flight, more of them queue at the
+  // client whatever the iodepth
+  conn_param.initiator_depth =
+      attr.max_qp_init_rd_atom < 255 ? attr.max_qp_init_rd_atom : 255;
+  conn_param.retry_count = 5;
+  conn_param.rnr_retry_count = RNR_RETRY_COUNT;
+  conn_param.private_data = test.rai->ai_connect;
+  conn_param.private_data_len = test.rai->ai_connect_len;
+  ret = rdma_connect(node->cma_id, &conn_param);
+  if (ret) {
+    perror("pmbenchmark: failure connecting");
+    goto err;
+  }
+  return 0;
+err:
+  connect_error();
+  return ret;
+}
+
+// server event
+static int connect_handler(struct rdma_cm_id *cma_id,
+                           struct rdma_conn_param *request) {
+  struct rdma_conn_param conn_param;
+  struct ibv_device_attr attr;
+  struct benchmark_node *node;
+  int i, ret;
+
+  if (test.conn_index == connections) {
+    ret = -ENOMEM;
+    goto err1;
+  }
+  node = &test.nodes[test.conn_index++];
+
+  node->cma_id = cma_id;
+  cma_id->context = node;
+
+  ret = init_node(node);
+  if (ret)
+    goto err2;
+
+  // post the request receives before accepting, SRQ is pre-posted
+  if (method->serve && !srq_size) {
+    for (i = 0; i < iodepth; ++i) {
+      ret = post_recv_request(node, i);
+      if (ret)
+        goto err2;
+    }
+  }
+
+  ret = ibv_query_device(cma_id->verbs, &attr);
+  if (ret) {
+    perror("pmbenchmark: failure querying device");
+    goto err2;
+  }
+
+  // grant the client's reads and atomics in flight up to what we serve
+  memset(&conn_param, 0, sizeof conn_param);
+  conn_param.responder_resources =
+      request->initiator_depth < attr.max_qp_rd_atom ? request->initiator_depth
+                                                     : attr.max_qp_rd_atom;
+  conn_param.initiator_depth = request->responder_resources;
+  node->server_metadata->rd_atomic = conn_param.responder_resources;
+
+  ret = rdma_accept(node->cma_id, &conn_param);
+  if (ret) {
+    perror("pmbenchmark: failure accepting");
+    goto err2;
+  }
+  return 0;
+
+err2:
+  node->cma_id = NULL;
+  connect_error();
+err1:
+  printf("pmbenchmark: failing connection request\n");
+  rdma_reject(cma_id, NULL, 0);
+  return ret;
+}
+
+static int cma_handler(struct rdma_cm_id *cma_id, struct rdma_cm_event *event) {
+  int ret = 0;
+
+  switch (event->event) {
+  case RDMA_CM_EVENT_ADDR_RESOLVED:
+    ret = addr_handler(cma_id->context);
+    break;
+  case RDMA_CM_EVENT_ROUTE_RESOLVED:
+    ret = route_handler(cma_id->context);
+    break;
+  case RDMA_CM_EVENT_CONNECT_REQUEST:
+    ret = connect_handler(cma_id, &event->param.conn);
+    break;
+  case RDMA_CM_EVENT_ESTABLISHED:
+    ((struct benchmark_node *)cma_id->context)->connected = 1;
+    test.connects_left--;
+    test.disconnects_left++;
+    break;
+  case RDMA_CM_EVENT_ADDR_ERROR:
+  case RDMA_CM_EVENT_ROUTE_ERROR:
+  case RDMA_CM_EVENT_CONNECT_ERROR:
+  case RDMA_CM_EVENT_UNREACHABLE:
+  case RDMA_CM_EVENT_REJECTED:
+    printf("pmbenchmark: event: %s, error: %d\n", rdma_event_str(event->event),
+           event->status);
+    connect_error();
+    ret = event->status;
+    break;
+  case RDMA_CM_EVENT_DISCONNECTED:
+    rdma_disconnect(cma_id);
+    test.disconnects_left--;
+    break;
+  case RDMA_CM_EVENT_DEVICE_REMOVAL:
+    /* Cleanup will occur after test completes. */
+    break;
+  default:
+    break;
+  }
+  return ret;
+}
+
+static void destroy_node(struct benchmark_node *node) {
+  if (!node->cma_id)
+    return;
+
+  if (node->cma_id->qp)
+    rdma_destroy_qp(node->cma_id);
+
+  // shared CQs are destroyed in destroy_nodes()
+  if (node->cq[SEND_CQ_INDEX] && !shared_cq_pollers)
+    ibv_destroy_cq(node->cq[SEND_CQ_INDEX]);
+
+  if (node->cq[RECV_CQ_INDEX] && !shared_cq_pollers)
+    ibv_destroy_cq(node->cq[RECV_CQ_INDEX]);
+  if (node->channel)
+    ibv_destroy_comp_channel(node->channel);
+
+  if (node->mr)
+    ibv_dereg_mr(node->mr);
+  if (node->shared_mr)
+    ibv_dereg_mr(node->shared_mr);
+  if (node->mem && !use_pmem && !method->shared_log)
+    free(node->mem);
+
+  if (node->src_mem_mr)
+    ibv_dereg_mr(node->src_mem_mr);
+  free(node->src_mem);
+
+  if (node->server_metadata_mr)
+    ibv_dereg_mr(node->server_metadata_mr);
+  free(node->server_metadata);
+
+  if (node->request_mr)
+    ibv_dereg_mr(node->request_mr);
+  free(node->requests);
+  if (node->reply_mr)
+    ibv_dereg_mr(node->reply_mr);
+  free(node->replies);
+
+  free(node->post_time);
+  free(node->nic_time);
+  free(node->send_wr);
+  free(node->send_sge);
+  free(node->recv_wr);
+  free(node->recv_sge);
+  free(node->stats);
+  free(node->server_stats);
+  if (node->method_mr)
+    ibv_dereg_mr(node->method_mr);
+  free(node->method_data);
+
+  if (node->pd && !srq_size)
+    ibv_dealloc_pd(node->pd);
+
+  /* Destroy the RDMA ID after all device resources */
+  rdma_destroy_id(node->cma_id);
+}
+
+static int alloc_nodes(void) {
+  int ret, i, buffers = method->shared_log ? 1 : connections;
+
+  test.nodes = malloc(sizeof *test.nodes * connections);
+  if (!test.nodes) {
+    printf("pmbenchmark: unable to allocate memory for test nodes\n");
+    return -ENOMEM;
+  }
+  memset(test.nodes, 0, sizeof *test.nodes * connections);
+
+  test.threads = malloc(sizeof *test.threads * connections);
+  if (!test.threads) {
+    printf("pmbenchmark: unable to allocate memory for threads\n");
+    return -ENOMEM;
+  }
+  memset(test.threads, 0, sizeof *test.threads * connections);
+
+  for (i = 0; i < connections; i++) {
+    test.nodes[i].id = i;
+    if (dst_addr) {
+      ret = rdma_create_id(test.channel, &test.nodes[i].cma_id, &test.nodes[i],
+                           hints.ai_port_space);
+      if (ret)
+        goto err;
+    }
+  }
+  if (use_pmem) {
+    pmem = pmem_map_file(pmem_file_path, 0 /* len */, 0 /* flags */, 0 /* mode */,
+                         &pmem_mapped_len, &is_pmem);
+    if (!pmem) {
+      printf("pmbenchmark: unable to allocate persistent memory %d\n", errno);
+      ret = -ENOMEM;
+      goto err;
+    }
+    if (!node_buffer_size() ||
+        pmem_mapped_len < shared_bytes() + node_buffer_size() * buffers) {
+      printf("pmbenchmark: not enough persistent memory %d\n", errno);
+      ret = -ENOMEM;
+      goto err;
+    }
+    shared_line = pmem;
+  } else if (!dst_addr && method->shared_word) {
+    shared_line = aligned_alloc(SLOT_ALIGN, SLOT_ALIGN);
+    if (!shared_line) {
+      printf("pmbenchmark: unable to allocate the shared line\n");
+      ret = -ENOMEM;
+      goto err;
+    }
+    memset(shared_line, 0, SLOT_ALIGN);
+  }
+  if (!dst_addr && !use_pmem && method->shared_log) {
+    log_buffer = aligned_alloc(SLOT_ALIGN, node_buffer_size());
+    if (!log_buffer) {
+      printf("pmbenchmark: unable to allocate the log\n");
+      ret = -ENOMEM;
+      goto err;
+    }
+  }
+  return 0;
+err:
+  while (--i >= 0)
+    rdma_destroy_id(test.nodes[i].cma_id);
+  free(test.nodes);
+  return ret;
+}
+
+static void destroy_nodes(void) {
+  int i;
+
+  for (i = 0; i < connections; i++)
+    destroy_node(&test.nodes[i]);
+
+  if (test.shared_cq[SEND_CQ_INDEX])
+    ibv_destroy_cq(test.shared_cq[SEND_CQ_INDEX]);
+  if (test.shared_cq[RECV_CQ_INDEX])
+    ibv_destroy_cq(test.shared_cq[RECV_CQ_INDEX]);
+
+  if (test.srq) {
+    stop_server();
+    pthread_join(test.srq_thread, NULL);
+    ibv_destroy_srq(test.srq);
+  }
+  if (stop_fd >= 0)
+    close(stop_fd);
+  if (test.srq_buff_mr)
+    ibv_dereg_mr(test.srq_buff_mr);
+  free(test.srq_buff);
+  free(test.srq_free);
+  free(test.qp_nodes);
+  if (test.pd)
+    ibv_dealloc_pd(test.pd);
+  if (!use_pmem) {
+    free(shared_line);
+    free(log_buffer);
+  }
+
+  free(test.nodes);
+}
+
+static int poll_one_wc(enum CQ_INDEX index) {
+  struct ibv_wc wc[8];
+  int done, i, ret;
+
+  for (i = 0; i < connections; i++) {
+    if (!test.nodes[i].connected)
+      continue;
+
+    for (done = 0; done < 1; done += ret) {
+      ret = ibv_poll_cq(test.nodes[i].cq[index], 1, wc);
+      if (ret < 0) {
+        printf("pmbenchmark: failed polling CQ: %d\n", ret);
+        return ret;
+      }
+      if (ret > 0 && debug_log)
+        printf("pmbenchmark: received work completion wr_id: %lu len: %u s: %s "
+               "f: %u\n",
+               wc->wr_id, wc->byte_len, ibv_wc_status_str(wc->status),
+               wc->wc_flags);
+    }
+  }
+  return 0;
+}
+
+static int node_poll_n_cq(struct benchmark_node *node, enum CQ_INDEX index,
+                          int n) {
+  struct ibv_wc wc[8];
+  int done, ret;
+
+  if (!node->connected)
+    return 0;
+
+  for (done = 0; done < n; done += ret) {
+    ret = ibv_poll_cq(node->cq[index], 1, wc);
+    if (ret < 0) {
+      printf("pmbenchmark: failed polling CQ: %d\n", ret);
+      return ret;
+    }
+  }
+  return 0;
+}
+
+// polls up to MAX_POLL_BATCH completions without blocking, fails on the
+// first one in error
+int node_poll_cq_batch(struct benchmark_node *node, enum CQ_INDEX index,
+                       struct ibv_wc *wc) {
+  int i, ret;
+
+  ret = ibv_poll_cq(node->cq[index], MAX_POLL_BATCH, wc);
+  if (ret < 0) {
+    printf("pmbenchmark: failed polling CQ: %d\n", ret);
+    return ret;
+  }
+  for (i = 0; i < ret; ++i) {
+    if (wc[i].status != IBV_WC_SUCCESS) {
+      printf("pmbenchmark: node %d wc error: %s\n", node->id,
+             ibv_wc_status_str(wc[i].status));
+      return -1;
+    }
+  }
+  return ret;
+}
+
+// ops complete with their signaled work request, which retires all the
+// unsignaled ones posted before it on the RC QP
+int poll_sends(struct benchmark_node *node, uint64_t *completed) {
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  int ret;
+
+  ret = node_poll_cq_batch(node, SEND_CQ_INDEX, wc);
+  if (ret > 0)
+    *completed = wc[ret - 1].wr_id + 1;
+  return ret;
+}
+
+// polls up to MAX_POLL_BATCH completions of an extended CQ in place
+// instead of copying them out as struct ibv_wc; each advances *completed
+// past its wr_id, with timestamps the ops it completes get its NIC time
+static int poll_cq_ex(struct benchmark_node *node, enum CQ_INDEX index,
+                      uint64_t *completed, bool timestamps) {
+  struct ibv_poll_cq_attr attr = {0};
+  struct ibv_cq_ex *cq = node->cq_ex[index];
+  uint64_t time;
+  int n = 0, ret;
+
+  ret = ibv_start_poll(cq, &attr);
+  if (ret == ENOENT)
+    return 0;
+  while (!ret) {
+    if (cq->status != IBV_WC_SUCCESS) {
+      printf("pmbenchmark: node %d wc error: %s\n", node->id,
+             ibv_wc_status_str(cq->status));
+      ibv_end_poll(cq);
+      return -1;
+    }
+    if (timestamps) {
+      time = hw_completion_ns(node, cq);
+      for (; *completed <= cq->wr_id; ++*completed)
+        node->nic_time[*completed % iodepth] = time;
+    }
+    *completed = cq->wr_id + 1;
+    if (++n == MAX_POLL_BATCH)
+      break;
+    ret = ibv_next_poll(cq);
+  }
+  if (n)
+    ibv_end_poll(cq);
+  if (ret && ret != ENOENT) {
+    printf("pmbenchmark: failed polling CQ: %d\n", ret);
+    return -ret;
+  }
+  return n;
+}
+
+// poll_sends on the cq_ex of --wr-api
+static int poll_sends_ex(struct benchmark_node *node, uint64_t *completed) {
+  return poll_cq_ex(node, SEND_CQ_INDEX, completed, false);
+}
+
+// poll_sends with the NIC completion times of --hw-timestamps
+static int poll_sends_ts(struct benchmark_node *node, uint64_t *completed) {
+  return poll_cq_ex(node, SEND_CQ_INDEX, completed, true);
+}
+
+// ops complete with the server's reply; send completions only free the
+// send queue
+int poll_replies(struct benchmark_node *node, uint64_t *completed) {
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  int ret;
+
+  ret = node_poll_cq_batch(node, SEND_CQ_INDEX, wc);
+  if (ret < 0)
+    return ret;
+  return poll_reply_cq(node, completed);
+}
+
+// the receive half of poll_replies, for methods that reap their send
+// completions themselves
+int poll_reply_cq(struct benchmark_node *node, uint64_t *completed) {
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  struct flush_notification *reply;
+  int i, ret;
+
+  ret = node_poll_cq_batch(node, RECV_CQ_INDEX, wc);
+  for (i = 0; i < ret; ++i) {
+    reply = &node->replies[wc[i].wr_id % iodepth];
+    if (reply->status) {
+      printf("pmbenchmark: node %d request rejected by server, status %u\n",
+             node->id, reply->status);
+      return -1;
+    }
+  }
+  if (ret > 0)
+    *completed = wc[ret - 1].wr_id + 1;
+  return ret;
+}
+
+// poll_replies with the NIC times of the reply receives, --hw-timestamps
+static int poll_replies_ts(struct benchmark_node *node, uint64_t *completed) {
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  uint64_t seq = *completed;
+  int ret;
+
+  ret = node_poll_cq_batch(node, SEND_CQ_INDEX, wc);
+  if (ret < 0)
+    return ret;
+  ret = poll_cq_ex(node, RECV_CQ_INDEX, completed, true);
+  for (; seq < *completed; ++seq) {
+    if (node->replies[seq % iodepth].status) {
+      printf("pmbenchmark: node %d request rejected by server, status %u\n",
+             node->id, node->replies[seq % iodepth].status);
+      return -1;
+    }
+  }
+  return ret;
+}
+
+static int connect_events(void) {
+  struct rdma_cm_event *event;
+  int ret = 0;
+
+  while (test.connects_left && !ret) {
+    ret = rdma_get_cm_event(test.channel, &event);
+    if (!ret) {
+      ret = cma_handler(event->id, event);
+      rdma_ack_cm_event(event);
+    } else {
+      perror("pmbenchmark: failure in rdma_get_cm_event in connect events");
+      ret = errno;
+    }
+  }
+
+  return ret;
+}
+
+static int disconnect_events(void) {
+  struct rdma_cm_event *event;
+  int ret = 0;
+
+  while (test.disconnects_left && !ret) {
+    ret = rdma_get_cm_event(test.channel, &event);
+    if (!ret) {
+      ret = cma_handler(event->id, event);
+      rdma_ack_cm_event(event);
+    } else {
+      perror("pmbenchmark: failure in rdma_get_cm_event in disconnect events");
+      ret = errno;
+    }
+  }
+
+  return ret;
+}
+
+// in SRQ mode wr_id names the receive buffer, the connection is found by QP
+// in test.qp_nodes, at most half full so a probe ends soon
+static struct benchmark_node *node_by_qp_num(uint32_t qp_num) {
+  struct benchmark_node *node;
+  unsigned i;
+
+  for (i = qp_num & test.qp_nodes_mask;
+       (node = __atomic_load_n(&test.qp_nodes[i], __ATOMIC_ACQUIRE));
+       i = (i + 1) & test.qp_nodes_mask)
+    if (node->cma_id->qp->qp_num == qp_num)
+      return node;
+  return NULL;
+}
+
+// connection of a received request, see post_recv_request()
+static struct benchmark_node *request_node(struct ibv_wc *wc) {
+  return srq_size ? node_by_qp_num(wc->qp_num)
+                  : &test.nodes[wc->wr_id / iodepth];
+}
+
+// drops the completions in error, their receives are not posted again
+static int successful_wcs(struct ibv_wc *wc, int n) {
+  int i, ok = 0;
+
+  for (i = 0; i < n; ++i)
+    if (wc[i].status == IBV_WC_SUCCESS)
+      wc[ok++] = wc[i];
+  return ok;
+}
+
+static char *request_buffer(struct benchmark_node *node, struct ibv_wc *wc) {
+  if (srq_size)
+    return test.srq_buff + wc->wr_id * request_bytes();
+  return node->requests + wc->wr_id % iodepth * request_bytes();
+}
+
+// serves the requests of one poll: the method flushes the ranges of each,
+// a single drain makes all of them durable, then each request gives its
+// receive back and gets its reply. The requests are persisted before their
+// buffers go back to the receive queue.
+static int serve_requests(struct ibv_wc *wc, int n, uint64_t *persisted,
+                          uint64_t *notified) {
+  struct benchmark_node *node;
+  uint8_t status[MAX_POLL_BATCH];
+  int i, ret;
+
+  for (i = 0; i < n; ++i) {
+    node = request_node(&wc[i]);
+    status[i] = method->serve(node, &wc[i], request_buffer(node, &wc[i]));
+  }
+  if (use_pmem)
+    pmem_drain();
+  *persisted = get_time_ns();
+
+  for (i = 0; i < n; ++i) {
+    node = request_node(&wc[i]);
+    if (srq_size) {
+      srq_release(wc[i].wr_id);
+    } else {
+      ret = post_recv_request(node, wc[i].wr_id % iodepth);
+      if (ret)
+        return ret;
+    }
+    ret = post_send_reply(node, status[i]);
+    if (ret)
+      return ret;
+    notified[i] = get_time_ns();
+  }
+  return 0;
+}
+
+// times are taken when polling started, the request was received, persisted,
+// the reply was posted and its send completion was reaped
+static void record_server_op(struct benchmark_node *node, uint64_t polled,
+                             uint64_t received, uint64_t persisted,
+                             uint64_t notified, uint64_t done) {
+  struct server_statistics *stats = node->server_stats;
+
+  stats->ops++;
+  stats->recv_wait += received - polled;
+  stats->persist += persisted - received;
+  stats->notify += notified - persisted;
+  stats->send_poll += done - notified;
+  hist_record(&stats->persist_hist, persisted - received);
+  hist_record(&stats->service_hist, done - received);
+}
+
+// serves what one poll of the node's receive CQ returns, up to recv_batch
+// requests that share the drain and the reaping of their reply sends;
+// returns the number served, < 0 on error
+static int serve_node(struct benchmark_node *node) {
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  uint64_t received, persisted, notified[MAX_POLL_BATCH], done;
+  int i, n, ret;
+
+  n = ibv_poll_cq(node->cq[RECV_CQ_INDEX], recv_batch, wc);
+  if (n < 0) {
+    printf("pmbenchmark: failed polling CQ: %d\n", n);
+    return n;
+  }
+  n = successful_wcs(wc, n);
+  if (!n)
+    return 0;
+  received = get_time_ns();
+  ret = serve_requests(wc, n, &persisted, notified);
+  if (ret) {
+    printf("pmbenchmark: worker serve_requests error %d\n", ret);
+    return ret;
+  }
+  ret = node_poll_n_cq(node, SEND_CQ_INDEX, n);
+  if (ret) {
+    printf("pmbenchmark: worker node_poll_n_cq error %d\n", ret);
+    return ret;
+  }
+  done = get_time_ns();
+  for (i = 0; i < n; ++i)
+    record_server_op(node, node->polled, received, persisted, notified[i],
+                     done);
+  node->polled = done; // the wait for the next requests starts here
+  return n;
+}
+
+// serves every owned connection once, returns the requests served
+static int serve_owned(int first) {
+  int i, n, served = 0;
+
+  for (i = first; i < connections; i += server_threads) {
+    n = serve_node(&test.nodes[i]);
+    if (n < 0)
+      return n;
+    served += n;
+  }
+  return served;
+}
+
+#define SPIN_MIN_NS 1000
+
+// A thread of the server pool owns every server_threads-th connection from
+// its index on. It polls them while requests come in and keeps polling for
+// a spin window after the last one, then arms their CQs and sleeps in
+// epoll until a completion channel or the stop eventfd fires. The window
+// adapts between SPIN_MIN_NS, or less if --spin is below it, and --spin: it
+// doubles when requests came back within it or soon after the thread fell
+// asleep, and halves when the thread slept longer, so bursty clients are
+// caught spinning and idle ones cost no CPU. --spin 0 arms and sleeps as
+// soon as the connections are idle.
+void *server_worker(void *index) {
+  int first = *(int *)index, i, n, epfd;
+  uint64_t spin_max = (uint64_t)spin_us * 1000, spin = spin_max, now,
+           idle_since,
+           spin_min = spin_max < SPIN_MIN_NS ? spin_max : SPIN_MIN_NS;
+  struct epoll_event event, events[MAX_POLL_BATCH];
+  struct benchmark_node *node;
+  struct ibv_cq *cq;
+  void *context;
+
+  epfd = epoll_create1(0);
+  if (epfd < 0) {
+    perror("pmbenchmark: epoll_create1");
+    return NULL;
+  }
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, stop_fd, &event))
+    goto err;
+  for (i = first; i < connections; i += server_threads) {
+    node = &test.nodes[i];
+    node->polled = get_time_ns();
+    event.data.ptr = node;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, node->channel->fd, &event))
+      goto err;
+  }
+
+  idle_since = get_time_ns();
+  while (!server_stop) {
+    n = serve_owned(first);
+    if (n < 0)
+      break;
+    now = get_time_ns();
+    if (n) {
+      if (now - idle_since > spin_min && spin < spin_max)
+        spin *= 2;
+      idle_since = now;
+      continue;
+    }
+    if (now - idle_since < spin)
+      continue;
+
+    // arm, then look once more so that a request that arrived before the
+    // CQ was armed is not slept through
+    for (i = first; i < connections; i += server_threads)
+      if (ibv_req_notify_cq(test.nodes[i].cq[RECV_CQ_INDEX], 0))
+        goto err;
+    n = serve_owned(first);
+    if (n < 0)
+      break;
+    if (n) {
+      idle_since = get_time_ns();
+      continue;
+    }
+
+    n = epoll_wait(epfd, events, MAX_POLL_BATCH, -1);
+    if (n < 0 && errno != EINTR)
+      goto err;
+    for (i = 0; i < n; ++i) {
+      node = events[i].data.ptr;
+      while (node && !ibv_get_cq_event(node->channel, &cq, &context))
+        ibv_ack_cq_events(cq, 1);
+    }
+    now = get_time_ns();
+    if (now - idle_since > 2 * spin_max)
+      spin = spin / 2 > spin_min ? spin / 2 : spin_min;
+    else if (spin < spin_max)
+      spin *= 2;
+    idle_since = now;
+  }
+  close(epfd);
+  return NULL;
+err:
+  perror("pmbenchmark: server worker");
+  close(epfd);
+  return NULL;
+}
+
+// serves all connections from the shared CQs, completions are dispatched to
+// the owning node by wr_id
+void *shared_cq_worker(void *arg) {
+  int i, n, ret;
+  struct ibv_wc wc[MAX_POLL_BATCH];
+  uint64_t received, persisted, notified[MAX_POLL_BATCH];
+
+  (void)arg;
+  while (!server_stop) {
+    // reclaim reply sends
+    ret = ibv_poll_cq(test.shared_cq[SEND_CQ_INDEX], MAX_POLL_BATCH, wc);
+    if (ret < 0) {
+      printf("pmbenchmark: failed polling shared send CQ: %d\n", ret);
+      return NULL;
+    }
+    n = ibv_poll_cq(test.shared_cq[RECV_CQ_INDEX], recv_batch, wc);
+    if (n < 0) {
+      printf("pmbenchmark: failed polling shared recv CQ: %d\n", n);
+      return NULL;
+    }
+    n = successful_wcs(wc, n);
+    if (!n)
+      continue;
+    received = get_time_ns();
+    ret = serve_requests(wc, n, &persisted, notified);
+    if (ret) {
+      printf("pmbenchmark: shared_cq_worker serve_requests error %d\n", ret);
+      return NULL;
+    }
+    // the poll is shared by all connections and send completions are
+    // reaped in bulk, only the phases of these requests are attributed
+    for (i = 0; i < n; ++i)
+      record_server_op(request_node(&wc[i]), received, received, persisted,
+                       notified[i], notified[i]);
+  }
+  return NULL;
+}
+
+// receive resources and RNR NAKs sent while serving, compares SRQ with
+// receives per QP as connections scale
+static void print_recv_stats(long long rnr_start, uint64_t start) {
+  struct rusage usage;
+  long long rnr_end;
+  uint64_t elapsed = get_time_ns() - start;
+  int wqes = srq_size ? srq_size : connections * iodepth;
+  unsigned long recv_bytes = wqes * request_bytes();
+
+  rnr_end = read_rnr_nak_counter(test.nodes[0].cma_id->verbs,
+                                 test.nodes[0].cma_id->port_num);
+  getrusage(RUSAGE_SELF, &usage);
+  puts("recv queue | connections | recv wqes | recv buffers [B] | "
+       "rnr retry | rnr naks | rnr naks/s | max rss [KB]");
+  if (rnr_start < 0 || rnr_end < 0)
+    printf("%s %d %d %lu %d n/a n/a %ld\n", srq_size ? "srq" : "qp",
+           connections, wqes, recv_bytes, RNR_RETRY_COUNT, usage.ru_maxrss);
+  else
+    printf("%s %d %d %lu %d %lld %f %ld\n", srq_size ? "srq" : "qp",
+           connections, wqes, recv_bytes, RNR_RETRY_COUNT,
+           rnr_end - rnr_start,
+           (double)(rnr_end - rnr_start) * 1000000000 / elapsed,
+           usage.ru_maxrss);
+}
+
+// server time per request split by phase, shows how much of the latency is
+// the flush itself and how much the messaging around it
+static void print_server_stats(uint64_t start) {
+  static struct latency_histogram persist, service;
+  struct server_statistics total, *stats;
+  struct rusage usage;
+  uint64_t elapsed = get_time_ns() - start, cpu;
+  int i;
+
+  memset(&total, 0, sizeof total);
+  printf("receive batch %d, server threads %d, spin %d us\n", recv_batch,
+         shared_cq_pollers ? shared_cq_pollers : server_threads, spin_us);
+  puts("th | ops | recv wait | persist | notify | send poll [avg ns] | "
+       "persist p99 [ns]");
+  for (i = 0; i < connections; i++) {
+    stats = test.nodes[i].server_stats;
+    if (!stats || !stats->ops)
+      continue;
+    printf("%d %lu %lu %lu %lu %lu %lu\n", i, stats->ops,
+           stats->recv_wait / stats->ops, stats->persist / stats->ops,
+           stats->notify / stats->ops, stats->send_poll / stats->ops,
+           hist_percentile(&stats->persist_hist, 99));
+    total.ops += stats->ops;
+    total.recv_wait += stats->recv_wait;
+    total.persist += stats->persist;
+    total.notify += stats->notify;
+    total.send_poll += stats->send_poll;
+    hist_merge(&persist, &stats->persist_hist);
+    hist_merge(&service, &stats->service_hist);
+  }
+  if (!total.ops)
+    return;
+  printf("all %lu %lu %lu %lu %lu\n", total.ops,
+         total.recv_wait / total.ops, total.persist / total.ops,
+         total.notify / total.ops, total.send_poll / total.ops);
+  puts("persist latency");
+  hist_print(&persist);
+  puts("service latency, request received to reply done");
+  hist_print(&service);
+
+  // pollers spin, so this is mostly the number of server threads
+  getrusage(RUSAGE_SELF, &usage);
+  cpu = (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+        (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+  puts("cpu busy [cores] | cpu/op [ns] | persist share of service [%]");
+  printf("%.2f %lu %.1f\n", (double)cpu / elapsed, cpu / total.ops,
+         100.0 * total.persist /
+             (total.persist + total.notify + total.send_poll));
+}
+
+// histogram the time series is taken from: client op latency, server
+// service time
+static const struct latency_histogram *series_hist(struct benchmark_node *node) {
+  if (dst_addr)
+    return node->stats ? &node->stats->hist : NULL;
+  return node->server_stats ? &node->server_stats->service_hist : NULL;
+}
+
+// prints ops/s, GB/s and the p99 of every interval to stderr, so the result
+// line on stdout stays the last thing scripts parse. The workers' histograms
+// are snapshotted without locks, ops are the recorded latencies.
+void *series_worker(void *arg) {
+  static struct latency_histogram now, last, delta;
+  const struct latency_histogram *hist;
+  const char *side = dst_addr ? "client" : "server";
+  struct timespec tick;
+  uint64_t start, prev, end;
+  double seconds;
+  int i;
+
+  (void)arg;
+  tick.tv_sec = series_interval / 1000;
+  tick.tv_nsec = (series_interval % 1000) * 1000000L;
+  if (!series_json)
+    fprintf(stderr, "side;time [s];ops;ops/s;GB/s;p99 [ns]\n");
+  start = prev = get_time_ns();
+  while (!series_stop) {
+    nanosleep(&tick, NULL);
+    memset(&now, 0, sizeof now);
+    for (i = 0; i < connections; i++) {
+      hist = series_hist(&test.nodes[i]);
+      if (hist)
+        hist_snapshot(&now, hist);
+    }
+    end = get_time_ns();
+    hist_delta(&delta, &now, &last);
+    last = now;
+    seconds = (double)(end - prev) / 1000000000;
+    prev = end;
+    if (series_json)
+      fprintf(stderr,
+              "{\"side\": \"%s\", \"time\": %.3f, \"ops\": %lu, "
+              "\"ops_per_sec\": %.0f, \"gb_per_sec\": %f, \"p99\": %lu}\n",
+              side, (double)(end - start) / 1000000000, delta.count,
+              delta.count / seconds,
+              (double)delta.count * op_size() / (1024 * 1024 * 1024) / seconds,
+              hist_percentile(&delta, 99));
+    else
+      fprintf(stderr, "%s;%.3f;%lu;%.0f;%f;%lu\n", side,
+              (double)(end - start) / 1000000000, delta.count,
+              delta.count / seconds,
+              (double)delta.count * op_size() / (1024 * 1024 * 1024) / seconds,
+              hist_percentile(&delta, 99));
+  }
+  return NULL;
+}
+
+static void start_series(void) {
+  if (series_interval)
+    pthread_create(&series_thread, NULL, series_worker, NULL);
+}
+
+static void stop_series(void) {
+  if (!series_interval)
+    return;
+  series_stop = true;
+  pthread_join(series_thread, NULL);
+}
+
+static int run_server(void) {
+  struct rdma_cm_id *listen_id;
+  long long rnr_start;
+  uint64_t start;
+  int i, ret, workers = 0;
+
+  printf("pmbenchmark: starting %s server\n", method->name);
+  stop_fd = eventfd(0, EFD_NONBLOCK);
+  if (stop_fd < 0) {
+    perror("pmbenchmark: eventfd");
+    return -errno;
+  }
+  ret = rdma_create_id(test.channel, &listen_id, &test, hints.ai_port_space);
+  if (ret) {
+    perror("pmbenchmark: listen request failed");
+    return ret;
+  }
+
+  ret = get_rdma_addr(src_addr, dst_addr, port, &hints, &test.rai);
+  if (ret) {
+    printf("pmbenchmark: getrdmaaddr error: %s\n", gai_strerror(ret));
+    goto out;
+  }
+
+  ret = rdma_bind_addr(listen_id, test.rai->ai_src_addr);
+  if (ret) {
+    perror("pmbenchmark: bind address failed");
+    goto out;
+  }
+
+  ret = rdma_listen(listen_id, 8);
+  if (ret) {
+    perror("pmbenchmark: failure trying to listen");
+    goto out;
+  }
+
+  ret = connect_events();
+  if (ret)
+    goto out;
+
+  if (method->serve_init) {
+    ret = method->serve_init(shared_line, test.nodes[0].mem,
+                             node_buffer_size());
+    if (ret)
+      goto out;
+  }
+
+  printf("exchanging metadata\n");
+  for (i = 0; i < connections; i++) {
+    server_set_metadata(&test.nodes[i]);
+    ret = post_send_metadata(&test.nodes[i]);
+    if (ret)
+      goto out;
+  }
+
+  printf("completing sends\n");
+  ret = poll_one_wc(SEND_CQ_INDEX);
+  if (ret)
+    goto out;
+
+  printf("metadata sent\n");
+
+  // one-sided methods need nothing from the server until the disconnect
+  rnr_start = read_rnr_nak_counter(test.nodes[0].cma_id->verbs,
+                                   test.nodes[0].cma_id->port_num);
+  start = get_time_ns();
+  if (method->serve && shared_cq_pollers) {
+    workers = shared_cq_pollers;
+    for (i = 0; i < workers; i++)
+      pthread_create(&test.threads[i], NULL, shared_cq_worker, NULL);
+  } else if (method->serve) {
+    // node ids double as the pool thread indexes
+    workers = server_threads;
+    for (i = 0; i < workers; i++)
+      pthread_create(&test.threads[i], NULL, server_worker,
+                     (void *)&test.nodes[i].id);
+  }
+  // one-sided methods record nothing on the server to report
+  if (method->serve)
+    start_series();
+
+  ret = disconnect_events(); // wait for disconnects
+
+  stop_server();
+  for (i = 0; i < workers; i++)
+    pthread_join(test.threads[i], NULL);
+  if (method->serve)
+    stop_series();
+
+  printf("disconnected\n");
+  if (method->serve) {
+    print_recv_stats(rnr_start, start);
+    print_server_stats(start);
+  }
+
+out:
+  rdma_destroy_id(listen_id);
+  return ret;
+}
+
+// drops what the worker recorded during warm-up, ops still in flight were
+// posted before and are not counted either
+static void start_measuring(struct benchmark_node *node, uint64_t posted) {
+  memset(node->stats, 0, sizeof(struct statistics));
+  node->stats->elapsed_nanoseconds = get_time_ns();
+  node->stats->cpu_nanoseconds = get_cpu_time_ns();
+  node->pacer.late = 0;
+  node->measured_from = posted;
+  node->measuring = true;
+}
+
+static void record_op(struct statistics *stats, uint64_t latency) {
+  stats->ops++;
+  stats->latency += latency;
+  hist_record(&stats->hist, latency);
+  if (stats->last_latency != 0)
+    stats->jitter += labs((long)stats->last_latency - (long)latency);
+  stats->last_latency = latency;
+}
+
+// the NIC completed the op, a time before the post is clock error
+static void record_nic_op(struct statistics *stats, uint64_t post_time,
+                          uint64_t nic_time) {
+  uint64_t latency = nic_time > post_time ? nic_time - post_time : 0;
+
+  stats->nic_latency += latency;
+  hist_record(&stats->nic_hist, latency);
+}
+
+// closed loop: the free slots are filled at once
+static bool closed_loop_due(struct benchmark_node *node, uint64_t *now) {
+  (void)node;
+  *now = get_time_ns();
+  return true;
+}
+
+// open loop: only the ops that are due, timed from the intended time
+static bool open_loop_due(struct benchmark_node *node, uint64_t *now) {
+  *now = get_time_ns();
+  if (!pacer_due(&node->pacer, *now))
+    return false;
+  *now = pacer_take(&node->pacer, *now);
+  return true;
+}
+
+// records the ops from first to done, all completed at end
+static void record_ops(struct benchmark_node *node, uint64_t first,
+                       uint64_t done, uint64_t end) {
+  for (; first < done; ++first)
+    record_op(node->stats, end - node->post_time[first % iodepth]);
+}
+
+// record_ops and the NIC completion times of --hw-timestamps
+static void record_nic_ops(struct benchmark_node *node, uint64_t first,
+                           uint64_t done, uint64_t end) {
+  for (; first < done; ++first) {
+    record_op(node->stats, end - node->post_time[first % iodepth]);
+    record_nic_op(node->stats, node->post_time[first % iodepth],
+                  node->nic_time[first % iodepth]);
+  }
+}
+
+// the hot path of every method: keeps up to iodepth ops in flight, posts
+// post_batch of them per doorbell and times each from its post to the
+// completion the method polls for. The load and what is recorded per op
+// are picked once, like the method, so the loop does not test them.
+void *worker(void *index) {
+  int ret, i, n;
+  uint64_t now, end, done, posted = 0, completed = 0;
+  struct benchmark_node *node = &test.nodes[*(int *)index];
+  bool (*due)(struct benchmark_node *, uint64_t *) =
+      rate ? open_loop_due : closed_loop_due;
+  void (*record)(struct benchmark_node *, uint64_t, uint64_t, uint64_t) =
+      hw_timestamps ? record_nic_ops : record_ops;
+
+  slot_ring_init(&node->ring, node->server_metadata->length / slot_size(),
+                 slot_size(), slot_order, node->id);
+  while (!begin) { /* wait */
+  }
+  node->stats->elapsed_nanoseconds = get_time_ns();
+  if (rate)
+    pacer_init(&node->pacer, rate, arrival, node->id,
+               node->stats->elapsed_nanoseconds);
+  node->stats->cpu_nanoseconds = get_cpu_time_ns();
+
+  while (!stop) {
+    if (!node->measuring && measure)
+      start_measuring(node, posted);
+    // fill the pipeline up to iodepth with the ops that are due
+    while (posted - completed < (uint64_t)iodepth) {
+      n = iodepth - (posted - completed);
+      if (n > post_batch)
+        n = post_batch;
+      if (!due(node, &now))
+        break;
+      for (i = 0; i < n; ++i)
+        node->post_time[(posted + i) % iodepth] = now;
+      ret = method->post(node, posted, n);
+      if (ret) {
+        printf("pmbenchmark: worker %s post error %d\n", method->name, ret);
+        return NULL;
+      }
+      posted += n;
+      node->stats->posted += n;
+      node->stats->doorbells++;
+    }
+    if (posted == completed)
+      continue;
+    done = completed;
+    ret = method->poll(node, &done);
+    if (ret < 0) {
+      printf("pmbenchmark: worker %s poll error %d\n", method->name, ret);
+      return NULL;
+    }
+    if (done == completed)
+      continue;
+    end = get_time_ns();
+    // ops posted before measuring started are not counted
+    record(node, completed > node->measured_from ? completed
+                                                 : node->measured_from,
+           done, end);
+    completed = done;
+  }
+  node->stats->elapsed_nanoseconds =
+      get_time_ns() - node->stats->elapsed_nanoseconds;
+  node->stats->late = node->pacer.late;
+  node->stats->cpu_nanoseconds =
+      get_cpu_time_ns() - node->stats->cpu_nanoseconds;
+  // drain ops still in flight, they are not counted; pad the pipeline up to
+  // the next signaled op so that the tail gets a completion
+  while (posted != completed) {
+    if (posted % signal_interval && posted - completed < (uint64_t)iodepth) {
+      ret = method->post(node, posted, 1);
+      if (ret) {
+        printf("pmbenchmark: worker %s post error %d\n", method->name, ret);
+        return NULL;
+      }
+      posted++;
+      continue;
+    }
+    ret = method->poll(node, &completed);
+    if (ret < 0) {
+      printf("pmbenchmark: worker %s poll error %d\n", method->name, ret);
+      return NULL;
+    }
+  }
+  if (debug_log) node_print_stats(node);
+  return NULL;
+}
+
+static uint64_t min_node_ops(void) {
+  uint64_t ops, min = UINT64_MAX;
+  int i;
+
+  for (i = 0; i < connections; i++) {
+    ops = __atomic_load_n(&test.nodes[i].stats->ops, __ATOMIC_RELAXED);
+    if (ops < min)
+      min = ops;
+  }
+  return min;
+}
+
+static uint64_t total_ops(void) {
+  uint64_t ops = 0;
+  int i;
+
+  for (i = 0; i < connections; i++)
+    ops += __atomic_load_n(&test.nodes[i].stats->ops, __ATOMIC_RELAXED);
+  return ops;
+}
+
+#define WARMUP_STEADY_WINDOWS 3
+
+// runs the workers until every connection did warmup_ops ops, or until the
+// throughput of WARMUP_STEADY_WINDOWS windows in a row stays within
+// warmup_tolerance percent of the window before; gives up after the
+// benchmark time
+static void warm_up(void) {
+  struct timespec window, poll = {0, 1000000};
+  uint64_t start = get_time_ns(), prev = start, now, ops, last_ops = 0;
+  uint64_t limit = (uint64_t)sleep_time.tv_sec * 1000000000;
+  double throughput, last_throughput = 0;
+  int steady = 0;
+
+  window.tv_sec = warmup_window / 1000;
+  window.tv_nsec = (warmup_window % 1000) * 1000000L;
+  while ((now = get_time_ns()) - start < limit) {
+    if (warmup_ops) {
+      if (min_node_ops() >= warmup_ops)
+        break;
+      nanosleep(&poll, NULL);
+      continue;
+    }
+    nanosleep(&window, NULL);
+    now = get_time_ns();
+    ops = total_ops();
+    throughput = (double)(ops - last_ops) / (now - prev);
+    if (last_throughput &&
+        fabs(throughput - last_throughput) <=
+            warmup_tolerance / 100 * last_throughput)
+      steady++;
+    else
+      steady = 0;
+    if (steady == WARMUP_STEADY_WINDOWS) {
+      warmup_steady = true;
+      break;
+    }
+    last_throughput = throughput;
+    last_ops = ops;
+    prev = now;
+  }
+  warmup_excluded = total_ops();
+  warmup_nanoseconds = get_time_ns() - start;
+}
+
+static int run_client(void) {
+  int i, ret, ret2;
+
+  if (debug_log) printf("pmbenchmark: starting %s client\n", method->name);
+
+  ret = get_rdma_addr(src_addr, dst_addr, port, &hints, &test.rai);
+  if (ret) {
+    printf("pmbenchmark: getaddrinfo error: %s\n", gai_strerror(ret));
+    return ret;
+  }
+
+  if (debug_log) printf("pmbenchmark: connecting\n");
+  for (i = 0; i < connections; i++) {
+    ret = rdma_resolve_addr(test.nodes[i].cma_id, test.rai->ai_src_addr,
+                            test.rai->ai_dst_addr, 2000);
+    if (ret) {
+      perror("pmbenchmark: failure getting addr");
+      connect_error();
+      return ret;
+    }
+  }
+
+  ret = connect_events();
+  if (ret)
+    goto disc;
+
+  if (debug_log)
+    printf("receiving metadata\n");
+  ret = poll_one_wc(RECV_CQ_INDEX);
+  if (ret)
+    goto disc;
+
+  for (i = 0; i < connections; i++) {
+    print_metadata(&test.nodes[i]);
+    if (test.nodes[i].server_metadata->length < slot_size()) {
+      printf("pmbenchmark: server buffer too small, start the server with "
+             "the same -m, -S and -r\n");
+      ret = -EINVAL;
+      goto disc;
+    }
+    if (method->serve &&
+        test.nodes[i].server_metadata->recv_depth < (uint32_t)iodepth) {
+      printf("pmbenchmark: server takes %u requests in flight, start it "
+             "with -d %d\n", test.nodes[i].server_metadata->recv_depth,
+             iodepth);
+      ret = -EINVAL;
+      goto disc;
+    }
+    if (method->serve &&
+        test.nodes[i].server_metadata->reply_depth < (uint32_t)iodepth) {
+      printf("pmbenchmark: server has %u replies in flight, start it with "
+             "-d %d\n", test.nodes[i].server_metadata->reply_depth,
+             iodepth);
+      ret = -EINVAL;
+      goto disc;
+    }
+    if (atomic_contended && !test.nodes[i].server_metadata->shared_address) {
+      printf("pmbenchmark: server has no shared line, start it with the "
+             "same -m\n");
+      ret = -EINVAL;
+      goto disc;
+    }
+    if (!i || test.nodes[i].server_metadata->rd_atomic < rd_atomic)
+      rd_atomic = test.nodes[i].server_metadata->rd_atomic;
+    test.nodes[i].inline_flag =
+        message_size <= test.nodes[i].max_inline_data ? IBV_SEND_INLINE : 0;
+    ret = create_method_data(&test.nodes[i]);
+    if (ret)
+      goto disc;
+    method->prepare(&test.nodes[i]);
+  }
+
+  if (debug_log)
+    printf("metadata received\n");
+  // run workers
+  for (i = 0; i < connections; i++) {
+    pthread_create(&test.threads[i], NULL, worker, (void *)&test.nodes[i].id);
+  }
+  nanosleep(&prepare_time, NULL);
+  measure = !warmup_ops && !warmup_window;
+  begin = true;
+  start_series();
+  if (!measure) {
+    warm_up();
+    measure = true;
+  }
+  nanosleep(&sleep_time, NULL); // benchmark work
+  stop = true;
+  stop_series();
+  // join workers
+  for (i = 0; i < connections; i++) {
+    pthread_join(test.threads[i], NULL);
+  }
+  // total statistics
+  memset(&total_stats, 0, sizeof(struct statistics));
+  for (i = 0; i < connections; i++) {
+    total_stats.latency += test.nodes[i].stats->latency;
+    total_stats.ops += test.nodes[i].stats->ops;
+    total_stats.jitter += test.nodes[i].stats->jitter;
+    total_stats.late += test.nodes[i].stats->late;
+    total_stats.failed += test.nodes[i].stats->failed;
+    total_stats.posted += test.nodes[i].stats->posted;
+    total_stats.doorbells += test.nodes[i].stats->doorbells;
+    hist_merge(&total_stats.hist, &test.nodes[i].stats->hist);
+    total_stats.nic_latency += test.nodes[i].stats->nic_latency;
+    hist_merge(&total_stats.nic_hist, &test.nodes[i].stats->nic_hist);
+    total_stats.elapsed_nanoseconds += test.nodes[i].stats->elapsed_nanoseconds;
+    total_stats.cpu_nanoseconds += test.nodes[i].stats->cpu_nanoseconds;
+  }
+  // avg time
+  total_stats.elapsed_nanoseconds =
+      total_stats.elapsed_nanoseconds / connections;
+  print_stats(&total_stats);
+
+  ret = 0;
+disc:
+
+  for (i = 0; i < connections; i++) {
+    rdma_disconnect(test.nodes[i].cma_id);
+  }
+  ret2 = disconnect_events();
+  if (ret2)
+    ret = ret2;
+
+  return ret;
+}
+
+static const struct method *find_method(const char *name) {
+  size_t i;
+
+  for (i = 0; i < sizeof methods / sizeof *methods; ++i)
+    if (!strcmp(methods[i]->name, name))
+      return methods[i];
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int op, ret, option_index;
+  size_t i;
+
+  timer_init();
+
+  sleep_time.tv_sec = 1;
+  sleep_time.tv_nsec = 0;
+  prepare_time.tv_sec = 1;
+  prepare_time.tv_nsec = 0;
+
+  hints.ai_port_space = RDMA_PS_TCP;
+  method = find_method(DEFAULT_METHOD);
+
+  static struct option long_options[] = {
+      {"pmem", required_argument, NULL, 0},
+      {"method", required_argument, NULL, 'm'},
+      {"inline", required_argument, NULL, 'I'},
+      {"iodepth", required_argument, NULL, 'd'},
+      {"signal", required_argument, NULL, 'n'},
+      {"batch", required_argument, NULL, 'B'},
+      {"shared-cq", required_argument, NULL, 'Q'},
+      {"srq", required_argument, NULL, 'R'},
+      {"ranges", required_argument, NULL, 'r'},
+      {"slots", required_argument, NULL, 'l'},
+      {"ring", no_argument, NULL, 'L'},
+      {"order", required_argument, NULL, 'o'},
+      {"rate", required_argument, NULL, 'O'},
+      {"arrival", required_argument, NULL, 'A'},
+      {"interval", required_argument, NULL, 'i'},
+      {"json", no_argument, NULL, 'j'},
+      {"warmup-ops", required_argument, NULL, 'w'},
+      {"warmup-window", required_argument, NULL, 'W'},
+      {"warmup-tolerance", required_argument, NULL, 'T'},
+      {"contended", no_argument, NULL, 'C'},
+      {"wr-api", no_argument, NULL, 'X'},
+      {"hw-timestamps", no_argument, NULL, 'H'},
+      {"recv-batch", required_argument, NULL, 'N'},
+      {"server-threads", required_argument, NULL, 'M'},
+      {"spin", required_argument, NULL, 'U'},
+      {NULL, 0, NULL, 0}};
+  while ((op = getopt_long(argc, argv,
+                           "s:b:f:P:c:S:t:p:a:m:d:n:B:Q:I:R:r:l:Lo:O:A:i:jw:W:T:CXHN:M:U:v0",
+                           long_options, &option_index)) != -1) {
+    switch (op) {
+    case 's':
+      dst_addr = optarg;
+      break;
+    case 'b':
+      src_addr = optarg;
+      break;
+    case 'f':
+      if (!strncasecmp("ip", optarg, 2)) {
+        hints.ai_flags = RAI_NUMERICHOST;
+      } else if (!strncasecmp("gid", optarg, 3)) {
+        hints.ai_flags = RAI_NUMERICHOST | RAI_FAMILY;
+        hints.ai_family = AF_IB;
+      } else if (strncasecmp("name", optarg, 4)) {
+        fprintf(stderr, "Warning: unknown address format\n");
+      }
+      break;
+    case 'P':
+      if (!strncasecmp("ib", optarg, 2)) {
+        hints.ai_port_space = RDMA_PS_IB;
+      } else if (strncasecmp("tcp", optarg, 3)) {
+        fprintf(stderr, "Warning: unknown port space format\n");
+      }
+      break;
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 'S':
+      message_size = atoi(optarg);
+      break;
+    case 't':
+      sleep_time.tv_sec = atoi(optarg);
+      break;
+    case 'p':
+      port = optarg;
+      break;
+    case 'a':
+      set_timeout = 1;
+      timeout = (uint8_t)strtoul(optarg, NULL, 0);
+      break;
+    case 'm':
+      method = find_method(optarg);
+      if (!method) {
+        fprintf(stderr, "%s: unknown method %s\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'd':
+      iodepth = atoi(optarg);
+      if (iodepth < 1) {
+        fprintf(stderr, "pmbenchmark: iodepth must be at least 1\n");
+        exit(1);
+      }
+      break;
+    case 'n':
+      signal_interval = atoi(optarg);
+      if (signal_interval < 1) {
+        fprintf(stderr, "pmbenchmark: signal interval must be at least 1\n");
+        exit(1);
+      }
+      break;
+    case 'B':
+      post_batch = atoi(optarg);
+      if (post_batch < 1 || post_batch > MAX_POST_BATCH) {
+        fprintf(stderr, "pmbenchmark: batch must be in range 1-%d\n",
+                MAX_POST_BATCH);
+        exit(1);
+      }
+      break;
+    case 'R':
+      srq_size = atoi(optarg);
+      break;
+    case 'r':
+      flush_ranges = atoi(optarg);
+      break;
+    case 'l':
+      slots = atoi(optarg);
+      break;
+    case 'Q':
+      shared_cq_pollers = atoi(optarg);
+      break;
+    case 'I':
+      inline_size = strtoul(optarg, NULL, 0);
+      break;
+    case 'v':
+      csv_output = true;
+      debug_log = false;
+      break;
+    case 'L':
+      ring_layout = true;
+      break;
+    case 'o':
+      if (parse_slot_order(optarg, &slot_order)) {
+        fprintf(stderr, "%s: unknown slot order %s\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'O':
+      rate = atof(optarg);
+      break;
+    case 'A':
+      if (parse_arrival(optarg, &arrival)) {
+        fprintf(stderr, "%s: unknown arrival process %s\n", argv[0], optarg);
+        exit(1);
+      }
+      break;
+    case 'i':
+      series_interval = atoi(optarg);
+      if (series_interval < 0) {
+        fprintf(stderr, "pmbenchmark: interval must not be negative\n");
+        exit(1);
+      }
+      break;
+    case 'j':
+      series_json = true;
+      break;
+    case 'w':
+      warmup_ops = strtoull(optarg, NULL, 0);
+      break;
+    case 'W':
+      warmup_window = atoi(optarg);
+      break;
+    case 'T':
+      warmup_tolerance = atof(optarg);
+      break;
+    case 'C':
+      atomic_contended = true;
+      break;
+    case 'X':
+      wr_api = true;
+      break;
+    case 'H':
+      hw_timestamps = true;
+      break;
+    case 'M':
+      server_threads = atoi(optarg);
+      break;
+    case 'U':
+      spin_us = atoi(optarg);
+      break;
+    case 'N':
+      recv_batch = atoi(optarg);
+      if (recv_batch < 1 || recv_batch > MAX_POLL_BATCH) {
+        fprintf(stderr, "pmbenchmark: receive batch must be in range 1-%d\n",
+                MAX_POLL_BATCH);
+        exit(1);
+      }
+      break;
+    case 0:
+      strcpy(pmem_file_path, optarg);
+      use_pmem = true;
+      break;
+    default:
+      printf("usage: %s\n", argv[0]);
+      printf("\t[-s server_address]\n");
+      printf("\t[-b bind_address]\n");
+      printf("\t[-f address_format]\n");
+      printf("\t    name, ip, ipv6, or gid\n");
+      printf("\t[-P port_space]\n");
+      printf("\t    tcp or ib\n");
+      printf("\t[-c connections]\n");
+      printf("\t[-S message_size]\n");
+      printf("\t[-t benchmark_time]\n");
+      printf("\t[-p port_number]\n");
+      printf("\t[-a ack_timeout]\n");
+      printf("\t[-m|--method name] persistence method, default %s\n",
+             DEFAULT_METHOD);
+      for (i = 0; i < sizeof methods / sizeof *methods; ++i)
+        printf("\t    %s: %s\n", methods[i]->name, methods[i]->description);
+      printf("\t[-I|--inline max_inline_size] 0 disables inline data\n");
+      printf("\t[-d|--iodepth ops_in_flight] the server needs the same\n");
+      printf("\t[-n|--signal signal_every_nth_op]\n");
+      printf("\t[-B|--batch ops_per_post]\n");
+      printf("\t[-Q|--shared-cq poller_threads] server: share CQs between "
+             "connections\n");
+      printf("\t[-R|--srq receive_pool_size] server: use a shared receive "
+             "queue\n");
+      printf("\t[-r|--ranges records] write-send: records written and "
+             "persisted per op\n");
+      printf("\t[-l|--slots slots] server: slots per connection, records of "
+             "the log-append log in DRAM, at least %d\n", MIN_LOG_RECORDS);
+      printf("\t[-v] enable csv ouput\n");
+      printf("\t[-L|--ring] server: give each connection a ring of slots "
+             "over its share of the pmem mapping\n");
+      printf("\t[-o|--order seq|stride|random] client: order of the remote "
+             "slots written\n");
+      printf("\t[-O|--rate ops_per_sec] client: open loop, offered load per "
+             "connection\n");
+      printf("\t[-A|--arrival const|poisson] client: open loop inter-arrival "
+             "times\n");
+      printf("\t[-i|--interval ms] print ops/s, GB/s and p99 to stderr "
+             "every interval\n");
+      printf("\t[-j|--json] interval lines as JSON instead of CSV\n");
+      printf("\t[-w|--warmup-ops ops] client: ops per connection left out "
+             "of the statistics\n");
+      printf("\t[-W|--warmup-window ms] client: warm up until throughput "
+             "is steady over %d windows\n", WARMUP_STEADY_WINDOWS);
+      printf("\t[-T|--warmup-tolerance percent] client: throughput change "
+             "between steady windows, default 5\n");
+      printf("\t[-C|--contended] client: atomics of all connections on one "
+             "word\n");
+      printf("\t[-X|--wr-api] client: post with the ibv_wr_* calls and poll "
+             "a cq_ex\n");
+      printf("\t[-H|--hw-timestamps] client: also report the latency to "
+             "the NIC's completion timestamps\n");
+      printf("\t[-N|--recv-batch requests] server: requests polled and "
+             "drained together, default %d\n", MAX_POLL_BATCH);
+      printf("\t[-M|--server-threads threads] server: threads serving the "
+             "connections, default one per connection\n");
+      printf("\t[-U|--spin us] server: longest poll of idle connections "
+             "before sleeping, default 50, 0 sleeps at once\n");
+      printf("\t[--pmem pmem_file_path]\n");
+      exit(1);
+    }
+  }
+
+  // shared CQs and SRQ are server modes, client workers poll their own CQs
+  if (dst_addr) {
+    shared_cq_pollers = 0;
+    srq_size = 0;
+  }
+  if (srq_size < 0)
+    srq_size = 0;
+  if (shared_cq_pollers < 0 || shared_cq_pollers > connections)
+    shared_cq_pollers = connections;
+  if (server_threads <= 0 || server_threads > connections)
+    server_threads = connections;
+  if (spin_us < 0)
+    spin_us = 0;
+
+  // open loop: every op is signaled so each one gets its own completion
+  // time, ops are posted one at a time when due
+  if (rate) {
+    if (signal_interval != 1 || post_batch != 1)
+      fprintf(stderr, "pmbenchmark: warning: open loop signals and posts "
+                      "every op, -n %d and -B %d are run and reported as "
+                      "1\n", signal_interval, post_batch);
+    signal_interval = 1;
+    post_batch = 1;
+  }
+  if (rate < 0) {
+    printf("%s: rate must not be negative\n", argv[0]);
+    exit(1);
+  }
+
+  if (signal_interval > iodepth) {
+    fprintf(stderr, "pmbenchmark: signal interval can't exceed iodepth\n");
+    exit(1);
+  }
+  if (post_batch > iodepth) {
+    fprintf(stderr, "pmbenchmark: batch can't exceed iodepth\n");
+    exit(1);
+  }
+  // ops are posted as their slots free up, at least signal_interval at a
+  // time; larger batches only form when one poll reaps several completions
+  if (post_batch > signal_interval)
+    fprintf(stderr, "pmbenchmark: warning: batch %d above signal interval "
+                    "%d, the ops per doorbell reported are what it "
+                    "achieved\n", post_batch, signal_interval);
+  if (flush_ranges < 1 || flush_ranges > method->max_ranges) {
+    printf("pmbenchmark: %s ranges must be between 1 and %d\n", method->name,
+           method->max_ranges);
+    exit(1);
+  }
+  if (warmup_ops && warmup_window) {
+    printf("pmbenchmark: warm up either by op count or until steady\n");
+    exit(1);
+  }
+  if (warmup_window < 0 || warmup_tolerance < 0) {
+    printf("pmbenchmark: warm-up window and tolerance must not be "
+           "negative\n");
+    exit(1);
+  }
+  if (slots < 1) {
+    printf("pmbenchmark: slots must be at least 1\n");
+    exit(1);
+  }
+  if (method->check && method->check())
+    exit(1);
+  if (!message_size)
+    message_size = DEFAULT_MESSAGE_SIZE;
+  if (!dst_addr) {
+    wr_api = false;
+    hw_timestamps = false;
+  }
+  // the hot path calls through the table, so swap in the ibv_wr_* and
+  // cq_ex functions once here; methods with send_ops post that way already
+  if (wr_api && !method->post_wr && !method->send_ops) {
+    printf("%s: %s has no ibv_wr_* path\n", argv[0], method->name);
+    exit(1);
+  }
+  if (hw_timestamps && method->poll != poll_replies &&
+      method->poll != poll_sends) {
+    printf("%s: %s has no timestamped completions\n", argv[0], method->name);
+    exit(1);
+  }
+  if (wr_api || hw_timestamps) {
+    wr_method = *method;
+    if (wr_api && method->post_wr) {
+      wr_method.post = method->post_wr;
+      wr_method.send_ops = method->wr_send_ops;
+    }
+    if (wr_api && wr_method.poll == poll_sends)
+      wr_method.poll = poll_sends_ex;
+    // ops complete on the reply receive or on their own send completion,
+    // that CQ gets the timestamps; a device without them fails the run
+    ts_cq = method->poll == poll_replies ? RECV_CQ_INDEX : SEND_CQ_INDEX;
+    if (hw_timestamps)
+      wr_method.poll =
+          ts_cq == RECV_CQ_INDEX ? poll_replies_ts : poll_sends_ts;
+    method = &wr_method;
+  }
+  if (atomic_contended && !method->shared_word) {
+    printf("%s: --contended needs an atomic method\n", argv[0]);
+    exit(1);
+  }
+
+  if (ring_layout && !dst_addr && !use_pmem) {
+    printf("%s: --ring needs --pmem\n", argv[0]);
+    exit(1);
+  }
+
+  test.connects_left = connections;
+
+  test.channel = create_first_event_channel();
+  if (!test.channel) {
+    exit(1);
+  }
+
+  if (alloc_nodes())
+    exit(1);
+
+  if (dst_addr) {
+    ret = run_client();
+  } else {
+    hints.ai_flags |= RAI_PASSIVE;
+    ret = run_server();
+  }
+
+  if (debug_log) printf("test complete\n");
+  destroy_nodes();
+  rdma_destroy_event_channel(test.channel);
+  if (test.rai)
+    rdma_freeaddrinfo(test.rai);
+
+  if (debug_log) printf("return status %d\n", ret);
+  return ret;
+}
@@ -0,0 +1,258 @@
+#ifndef PMBENCHMARK_H
+#define PMBENCHMARK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include <rdma/rdma_cma.h>
+
+struct __attribute((packed)) rdma_buffer_attr {
+  uint64_t address;
+  uint64_t length;
+  union key {
+    /* if we send, we call it local key */
+    uint32_t local_key;
+    /* if we receive, we call it remote key */
+    uint32_t remote_key;
+  } key;
+  uint32_t recv_depth; // requests the server can take per connection
+  uint64_t shared_address; // line targeted by all connections, 0 if none
+  uint32_t shared_key;
+  uint32_t rd_atomic; // reads and atomics in flight the server accepted
+  uint32_t reply_depth; // replies the server can have in flight per connection
+};
+
+// reply of the server once a request is persisted
+struct __attribute((packed)) flush_notification {
+  uint64_t address; // or index / write id
+  uint8_t status; // > 0 error, == 0 success
+};
+
+struct statistics {
+  uint64_t ops;
+  uint64_t latency;
+  uint64_t last_latency;
+  uint64_t jitter;
+  uint64_t elapsed_nanoseconds;
+  uint64_t cpu_nanoseconds;
+  uint64_t late; // open loop ops issued behind schedule
+  uint64_t failed; // compare and swap ops whose compare failed
+  uint64_t posted;    // ops posted while measuring
+  uint64_t doorbells; // posts they took, the achieved batch is their ratio
+  struct latency_histogram hist;
+  // --hw-timestamps: from the post to the completion time the NIC wrote in
+  // the CQE, without the polling and scheduling delay of the host
+  uint64_t nic_latency;
+  struct latency_histogram nic_hist;
+};
+
+// server time spent per request, split by phase
+struct server_statistics {
+  uint64_t ops;
+  uint64_t recv_wait; // polling until the request arrived
+  uint64_t persist;
+  uint64_t notify;    // receive re-post and notification post
+  uint64_t send_poll; // notification send completion, 0 for shared CQs
+  struct latency_histogram persist_hist;
+  struct latency_histogram service_hist; // request received to reply done
+};
+
+// maps the completion timestamps of a CQ to get_time_ns(); HCA ticks are
+// scaled by a rate measured against the first sync, wall clock ones only
+// need an offset
+struct hw_clock {
+  bool wallclock;
+  uint64_t ticks;       // at the last sync
+  uint64_t ns;          // get_time_ns() at the last sync
+  uint64_t first_ticks; // at the first sync
+  uint64_t first_ns;
+  double ns_per_tick;
+  int64_t wall_offset; // get_time_ns() - CLOCK_REALTIME
+};
+
+struct benchmark_node {
+  int id;
+  struct rdma_cm_id *cma_id;
+  int connected;
+  struct ibv_pd *pd;
+  struct ibv_cq *cq[2];
+  struct ibv_qp_ex *qpx; // client: extended send ops, NULL without them
+  // client: extended CQs, the send CQ with --wr-api, the one completing
+  // the ops with --hw-timestamps
+  struct ibv_cq_ex *cq_ex[2];
+  struct hw_clock clock; // client: of the timestamped CQ
+  uint64_t *nic_time; // client: NIC completion time of each op in flight
+  struct ibv_mr *mr;
+  struct ibv_mr *src_mem_mr;
+  struct ibv_mr *server_metadata_mr;
+  struct ibv_mr *request_mr;
+  struct ibv_mr *reply_mr;
+  struct ibv_mr *shared_mr; // server: the line shared by all connections
+  struct statistics *stats;
+  struct server_statistics *server_stats;
+  struct rdma_buffer_attr *server_metadata;
+  char *requests; // iodepth buffers of method->request_size bytes
+  struct flush_notification *replies; // iodepth buffers
+  void *src_mem;
+  void *mem;
+  uint64_t *post_time; // client: post time of each op in flight
+  // client: work requests of one post, their fixed fields are filled by
+  // method->prepare so the hot path only sets addresses and flags
+  struct ibv_send_wr *send_wr;
+  struct ibv_sge *send_sge;
+  struct ibv_recv_wr *recv_wr;
+  struct ibv_sge *recv_sge;
+  uint32_t max_inline_data; // granted to the connection's QP
+  unsigned inline_flag; // IBV_SEND_INLINE if a message fits inline
+  unsigned request_flag; // IBV_SEND_INLINE if the method's request fits
+  atomic_uint_fast64_t replies_sent; // server: picks the reply buffer
+  // server: wakes the pool thread that owns the connection
+  struct ibv_comp_channel *channel;
+  uint64_t polled; // server: the wait for the next requests started
+  // client: the method's state, method->node_data bytes, the leading ones
+  // registered in method_mr for the NIC to access
+  void *method_data;
+  struct ibv_mr *method_mr;
+  struct slot_ring ring; // client: remote slots visited by the writes
+  struct pacer pacer; // client: open loop schedule
+  bool measuring; // client: warm-up is over for this worker
+  uint64_t measured_from; // client: first op counted in the statistics
+};
+
+enum CQ_INDEX { SEND_CQ_INDEX, RECV_CQ_INDEX };
+
+#define MAX_POLL_BATCH 16
+#define MAX_POST_BATCH 64
+
+// A persistence method is the table of functions on its hot path. It is
+// picked once at start up, the worker loops call through it and never test
+// which method runs.
+struct method {
+  const char *name;
+  const char *description;
+  int send_wrs;        // client work requests per op
+  int max_ranges;      // records written and persisted per op
+  size_t request_size; // server receive buffer per request
+  bool request_payload; // the op's records follow the request in its SEND
+  size_t max_buffer;   // cap of the server buffer of a connection, 0 if none
+  size_t slot_extra;   // bytes of a slot after the records, a commit marker
+  bool shared_word;    // server: exposes a line to all connections
+  bool shared_log;     // server: all connections share one buffer, the log
+  bool swaps;          // client: ops fail when their compare does
+  // client: bytes of state the method keeps per connection, once the
+  // server's buffer is known, the first *nic_bytes of them are registered
+  // for the NIC to access; 0 if the connection can't be served, NULL
+  // if it keeps none
+  size_t (*node_data)(struct benchmark_node *node, size_t *nic_bytes);
+  int access;          // server: access flags of the buffer besides remote
+                       // read, write and atomics
+  // client: ibv_wr_* ops the QP is created with, 0 if it posts through
+  // ibv_post_send only
+  uint64_t send_ops;
+  int (*check)(void);  // validates the options, NULL if all are supported
+  // client: fills the fixed fields of node->send_wr, once per connection
+  void (*prepare)(struct benchmark_node *node);
+  // client: posts n ops, numbered from seq, with one doorbell
+  int (*post)(struct benchmark_node *node, uint64_t seq, int n);
+  // client: post through the ibv_wr_* calls instead, for --wr-api, and the
+  // extended send ops it needs; NULL if the method has no such path
+  int (*post_wr)(struct benchmark_node *node, uint64_t seq, int n);
+  uint64_t wr_send_ops;
+  // client: reaps completions without blocking, advances *completed past
+  // the ops that are done, returns < 0 on error
+  int (*poll)(struct benchmark_node *node, uint64_t *completed);
+  // server: flushes the ranges of the request out of the CPU caches and
+  // returns the reply status, the engine drains once per polled batch
+  // before any reply goes out, a method that needs a request durable
+  // before it returns drains on its own; NULL if the server stays passive
+  // and the client only does one-sided operations
+  uint8_t (*serve)(struct benchmark_node *node, struct ibv_wc *wc,
+                   void *request);
+  // server: sets up the method's state on the shared line and the buffer
+  // once they exist, before any request; NULL if it keeps none
+  int (*serve_init)(void *shared, char *buffer, size_t length);
+};
+
+extern const struct method write_method;
+extern const struct method write_read_method;
+extern const struct method write_send_method;
+extern const struct method write_imm_method;
+extern const struct method read_method;
+extern const struct method fetch_add_method;
+extern const struct method fetch_add_read_method;
+extern const struct method cmp_swap_method;
+extern const struct method cmp_swap_read_method;
+extern const struct method write_flush_method;
+extern const struct method write_marker_method;
+extern const struct method write_marker_flush_method;
+extern const struct method write_atomic_marker_method;
+extern const struct method write_atomic_marker_flush_method;
+extern const struct method send_copy_method;
+extern const struct method log_append_method;
+
+extern unsigned message_size;
+extern int iodepth;
+extern int signal_interval;
+extern int post_batch;
+extern int flush_ranges;
+extern uint32_t max_inline_data;
+extern bool use_pmem;
+extern bool atomic_contended;
+
+size_t op_size(void);
+size_t slot_size(void);
+size_t node_buffer_size(void);
+int post_recv_replies(struct benchmark_node *node, uint64_t seq, int n);
+int poll_sends(struct benchmark_node *node, uint64_t *completed);
+int poll_replies(struct benchmark_node *node, uint64_t *completed);
+int node_poll_cq_batch(struct benchmark_node *node, enum CQ_INDEX index,
+                       struct ibv_wc *wc);
+int poll_reply_cq(struct benchmark_node *node, uint64_t *completed);
+
+// offset of the next slot of the connection's ring in the server buffer
+static inline uint64_t next_slot_offset(struct benchmark_node *node) {
+  return slot_ring_next(&node->ring) * slot_size();
+}
+
+// only every signal_interval-th op asks for a completion
+static inline unsigned op_signal(uint64_t seq) {
+  return (seq + 1) % signal_interval == 0 ? IBV_SEND_SIGNALED : 0;
+}
+
+// the message of an op as the payload of the ibv_wr_* op just started
+static inline void wr_set_message(struct benchmark_node *node) {
+  if (node->inline_flag)
+    ibv_wr_set_inline_data(node->qpx, node->src_mem, message_size);
+  else
+    ibv_wr_set_sge(node->qpx, node->src_mem_mr->lkey,
+                   (uintptr_t)node->src_mem, message_size);
+}
+
+// rings the doorbell for the ops since ibv_wr_start()
+static inline int wr_complete(struct benchmark_node *node) {
+  int ret = ibv_wr_complete(node->qpx);
+
+  if (ret)
+    printf("pmbenchmark: node %d failed to post send: %d\n", node->id, ret);
+  return ret;
+}
+
+// posts the prepared work requests of n ops, each op_wrs long
+static inline int post_prepared(struct benchmark_node *node, int n,
+                                int op_wrs) {
+  struct ibv_send_wr *last = &node->send_wr[n * op_wrs - 1], *bad_send_wr;
+  int ret;
+
+  last->next = NULL;
+  ret = ibv_post_send(node->cma_id->qp, node->send_wr, &bad_send_wr);
+  last->next = last + 1;
+  if (ret)
+    printf("pmbenchmark: node %d failed to post send: %d\n", node->id, ret);
+  return ret;
+}
+
+#endif
@@ -509,6 +509,7 @@ class ClientWorkerThread {
 
     // thread main
     void operator()() {
+      uint64_t start = Timer::Ticks();
       int ret = client_.send_write();
       if (ret) {
         std::cerr << "Failed to write, ret = " << ret << std::endl;
@@ -519,6 +520,12 @@ class ClientWorkerThread {
         std::cerr << "Failed to read, ret = " << ret << std::endl;
         return;
       }
+      uint64_t ticks = Timer::Ticks() - start;
+      statistics_.Record(ticks);
+      statistics_.elapsed_nanoseconds += Timer::ToNanoseconds(ticks);
+      std::cout << Statistics::GetHeader() << std::endl
+                << statistics_.ToString() << std::endl
+                << Timer::Describe() << std::endl;
       ret = client_.cmp_data();
       if (ret) {
         std::cerr << "Buffers are not equal, ret = " << ret << std::endl;
@@ -547,6 +554,7 @@ int main(int argc, char *argv[]) {
   std::string server_port = "2000";
   std::string data = "hello";
   std::cout << "client starts" << std::endl;
+  Timer::Init();
   option opts[]{{"serveraddr", required_argument, nullptr, 'a'},
                 {"serverport", required_argument, nullptr, 'p'},
                 {"data", required_argument, nullptr, 'd'},
@@ -1,5 +1,9 @@
 #include "common.hpp"
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
 int get_addr(const char *dst, struct sockaddr *addr) {
   struct addrinfo *res;
   int ret = -1;
@@ -202,3 +206,40 @@ std::string Statistics::ToString() const {
             std::to_string(static_cast<double>(ops) * 256 / (1024 * 1024 * 1024) * 1000000000 /     elapsed_nanoseconds);
         return text;
 }
+
+static uint64_t monotonic_raw_ns() {
+  struct timespec spec;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+  return static_cast<uint64_t>(spec.tv_sec) * 1000000000 + spec.tv_nsec;
+}
+
+void Timer::Init() {
+#if defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx, aux;
+  // CPUID.80000007H:EDX[8], the TSC ticks at a constant rate in all states
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8))) {
+    uint64_t ns_start = monotonic_raw_ns();
+    uint64_t tsc_start = __rdtscp(&aux);
+    uint64_t ns;
+    do {
+      ns = monotonic_raw_ns() - ns_start;
+    } while (ns < 50000000);
+    mult_ = (ns << 32) / (__rdtscp(&aux) - tsc_start);
+    use_tsc_ = true;
+  }
+#endif
+  constexpr int samples = 100000;
+  uint64_t start = Ticks();
+  for (int i = 0; i < samples; ++i)
+    Ticks();
+  overhead_ns_ =
+      ToNanoseconds(Ticks() - start) / static_cast<double>(samples);
+}
+
+std::string Timer::Describe() {
+  std::string text = use_tsc_
+      ? "timer: tsc " + std::to_string(static_cast<double>(1ull << 32) / mult_) +
+            " GHz"
+      : std::string("timer: clock_monotonic");
+  return text + ", overhead " + std::to_string(overhead_ns_) + " ns";
+}
@@ -6,6 +6,8 @@
 #include <thread>
 #include <atomic>
 #include <cstring>
+#include <ctime>
+#include <string>
 
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -15,6 +17,10 @@
 #include <infiniband/verbs.h>
 #include <rdma/rdma_cma.h>
 
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
 /* Capacity of the completion queue (CQ) */
 #define CQ_CAPACITY (16)
 /* MAX SGE capacity */
@@ -59,6 +65,39 @@ int process_work_completion_events(struct ibv_comp_channel *comp_channel,
 
 void show_rdma_cmid(struct rdma_cm_id *id);
 
+/* Clock of the benchmark loops. Init() calibrates the invariant TSC against
+ * CLOCK_MONOTONIC_RAW, without one ticks are CLOCK_MONOTONIC nanoseconds.
+ */
+class Timer {
+  public:
+    static void Init();
+    static std::string Describe();
+
+    static uint64_t Ticks() {
+#if defined(__x86_64__)
+      unsigned int aux;
+      if (use_tsc_)
+        return __rdtscp(&aux);
+#endif
+      struct timespec spec;
+      clock_gettime(CLOCK_MONOTONIC, &spec);
+      return static_cast<uint64_t>(spec.tv_sec) * 1000000000 + spec.tv_nsec;
+    }
+
+    static uint64_t ToNanoseconds(uint64_t ticks) {
+      if (!use_tsc_)
+        return ticks;
+      return static_cast<unsigned __int128>(ticks) * mult_ >> 32;
+    }
+
+    static double OverheadNanoseconds() { return overhead_ns_; }
+
+  private:
+    static inline bool use_tsc_ = false;
+    static inline uint64_t mult_ = 0; // ns per tick, 32.32 fixed point
+    static inline double overhead_ns_ = 0;
+};
+
 struct Statistics {
      int thread_id;
 
@@ -68,6 +107,11 @@ struct Statistics {
      uint64_t elapsed_nanoseconds = 0;
 
      explicit Statistics(int thread_id) : thread_id(thread_id) {}
+     void Record(uint64_t ticks) {
+       ops++;
+       latency_ticks += ticks;
+       latency += Timer::ToNanoseconds(ticks);
+     }
      static std::string GetHeader();
      std::string ToString() const;
 };